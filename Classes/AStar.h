@@ -7,13 +7,14 @@
 #pragma once
 
 #include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
 #include <functional>
 #include "Misc/NonCopyable.h"
 
 namespace a_star
 {
-	struct Node;
-
 	struct Vec2
 	{
 		unsigned short row;
@@ -37,15 +38,57 @@ namespace a_star
 
 	typedef std::function<bool(const Vec2&)> QueryCallBack;
 
-	struct AStarParam
+	/* 开启列表的实现 */
+	enum QueueType
+	{
+		BINARY_HEAP,	// 带位置索引的二叉堆，更新 g 值为 O(log n)
+		BUCKET_QUEUE,	// 按 f 值分桶（Dial），插入与取出为 O(1)
+	};
+
+	/* 搜索参数，可达判断由模板参数提供 */
+	struct SearchParam
 	{
 		bool			allow_corner;
 		unsigned short	total_row;
 		unsigned short	total_col;
 		Vec2			start_point;
-		Vec2			end_point;	
+		Vec2			end_point;
+		QueueType		queue_type;
+		bool			jump_point;		// 使用跳点搜索（JPS），只扩展跳点，路径与普通搜索等长
+		SearchParam() : allow_corner(false), total_row(0), total_col(0), queue_type(BINARY_HEAP), jump_point(false) {}
+	};
+
+	struct AStarParam : public SearchParam
+	{
 		QueryCallBack	is_can_reach;
-		AStarParam() : total_row(0), total_col(0), is_can_reach(nullptr), allow_corner(false) {}
+		AStarParam() : is_can_reach(nullptr) {}
+	};
+
+	/* Node state */
+	enum
+	{
+		NOTEXIST,
+		IN_OPENLIST,
+		IN_CLOSELIST
+	};
+
+	const int kStep = 10;
+	const int kOblique = 14;
+
+	/* 每个格子一个节点，存放在平坦数组中跨搜索复用，generation 与当前搜索不同时视为不存在 */
+	struct Node
+	{
+		unsigned int	g;
+		unsigned int	h;
+		Vec2			pos;
+		int				state;
+		int				heap_index;		// 在二叉堆中的位置
+		unsigned int	generation;		// 最后一次被访问时的搜索代数
+		Node*			parent;
+
+		int f() const { return g + h; }
+
+		Node() : g(0), h(0), state(NOTEXIST), heap_index(-1), generation(0), parent(nullptr) {}
 	};
 
 	/**
@@ -60,27 +103,69 @@ namespace a_star
 	public:
 		std::vector<Vec2> Search(const AStarParam &param);
 
+		/**
+		 * 只计算路径步数，不构造路径
+		 * @param is_can_reach 可达判断，函数对象的类型作为模板参数，调用可以内联
+		 * @return 步数，不可达时返回 -1
+		 */
+		template <typename Query>
+		int SearchDistance(const SearchParam &param, Query is_can_reach);
+
+		/**
+		 * 搜索路径并写入调用者提供的缓冲区，路径不含起点
+		 * @param out 输出缓冲区
+		 * @param capacity 缓冲区容量，路径更长时只写入前 capacity 个点
+		 * @return 步数，不可达时返回 -1
+		 */
+		template <typename Query>
+		int SearchPath(const SearchParam &param, Query is_can_reach, Vec2 *out, size_t capacity);
+
 	private:
 		void Clear();
 
-		void Init(const AStarParam &param);
+		void Init(const SearchParam &param);
+
+		bool InvalidParam(const SearchParam &param);
+
+		/* 执行搜索，返回终点节点，不可达时返回 nullptr。调用者读取结果后需调用 Clear */
+		template <typename Query>
+		Node* SearchImpl(const SearchParam &param, Query &query);
+
+		template <typename Query>
+		bool IsCanReach(const Vec2 &point, Query &query);
+
+		template <typename Query>
+		bool IsCanReach(const Vec2 &current, const Vec2 &target, bool allow_corner, Query &query);
 
-		bool InvalidParam(const AStarParam &param);
+		template <typename Query>
+		bool IsWalkable(int row, int col, Query &query);
+
+		/* 从 from 沿 (row_dir, col_dir) 方向跳跃，找到跳点时写入 out */
+		template <typename Query>
+		bool Jump(const Vec2 &from, int row_dir, int col_dir, const Vec2 &end_point, Query &query, Vec2 &out);
+
+		/* 按父节点方向裁剪邻居，对每个方向跳跃并加入开启列表 */
+		template <typename Query>
+		void ExpandJumpPoints(Node *current, const Vec2 &end_point, Query &query);
 
 	private:
+		bool IsOpenListEmpty() const;
+
+		void PushOpenList(Node *node);
+
+		Node* PopOpenList();
+
+		void DecreaseKey(Node *node);
+
 		void PercolateUp(int hole);
 
-		int GetNodeIndex(Node *node);
+		void PercolateDown(int hole);
 
 		bool HasNodeInCloseList(const Vec2 &point);
 
 		bool HasNodeInOpenList(const Vec2 &point, Node *&out);
 
-		bool IsCanReach(const Vec2 &point);
-
-		bool IsCanReach(const Vec2 &current, const Vec2 &target, bool allow_corner);
-
-		void SearchCanReachThePosition(const Vec2 &current, bool allow_corner, std::vector<Vec2> &can_each_pos);
+		Node* GetNode(const Vec2 &point);
 
 		unsigned int CalculG(Node *parent, const Vec2 &current);
 
@@ -90,12 +175,305 @@ namespace a_star
 
 		void HandleNotFoundNode(Node *current, Node *target, const Vec2 &end_point);
 
+		/* 路径步数，跳点之间的线段按格子计算 */
+		int CountSteps(Node *node);
+
+		/* 从终点向起点回填路径，只写入前 capacity 个点 */
+		void FillPath(Node *node, int steps, Vec2 *out, size_t capacity);
+
 	private:
 		unsigned short		total_row_;
 		unsigned short		total_col_;
 		unsigned int		map_size_;
-		QueryCallBack		query_func_;
+		QueueType			queue_type_;
+		bool				allow_corner_;
+		unsigned int		generation_;	// 当前搜索代数，每次搜索加一
 		std::vector<Node *>	open_list_;
-		std::vector<Node *>	maps_index_;
+		std::vector<Node>	nodes_;
+
+		/* 桶队列: 下标为 f 值，更新 g 值时重新插入，取出时跳过过期的项 */
+		std::vector<std::vector<Node *>>	buckets_;
+		unsigned int		bucket_min_;	// 可能非空的最小桶
+		unsigned int		bucket_max_;	// 使用过的最大桶
+		unsigned int		bucket_size_;	// 开启列表中的节点数
 	};
+
+	/************************************************************************/
+
+	inline bool AStar::HasNodeInOpenList(const Vec2 &point, Node *&out)
+	{
+		out = &nodes_[point.row * total_col_ + point.col];
+		return out->generation == generation_ && out->state == IN_OPENLIST;
+	}
+
+	inline bool AStar::HasNodeInCloseList(const Vec2 &point)
+	{
+		const Node &node = nodes_[point.row * total_col_ + point.col];
+		return node.generation == generation_ && node.state == IN_CLOSELIST;
+	}
+
+	inline Node* AStar::GetNode(const Vec2 &point)
+	{
+		Node *node = &nodes_[point.row * total_col_ + point.col];
+		if (node->generation != generation_)
+		{
+			node->g = 0;
+			node->h = 0;
+			node->pos = point;
+			node->state = NOTEXIST;
+			node->heap_index = -1;
+			node->generation = generation_;
+			node->parent = nullptr;
+		}
+		return node;
+	}
+
+	template <typename Query>
+	inline bool AStar::IsCanReach(const Vec2 &point, Query &query)
+	{
+		return (point.col < total_col_ && point.row < total_row_) ? query(point) : false;
+	}
+
+	template <typename Query>
+	inline bool AStar::IsCanReach(const Vec2 &current, const Vec2 &target, bool allow_corner, Query &query)
+	{
+		if (target.col < total_col_ && target.row < total_row_)
+		{
+			if (HasNodeInCloseList(target)) return false;
+			const int row_offset = abs(target.row - current.row);
+			const int col_offset = abs(target.col - current.col);
+			if (row_offset + col_offset == 1)
+			{
+				return query(target);
+			}
+			else if (allow_corner && row_offset == 1 && col_offset == 1)
+			{
+				// 斜向移动时两侧的格子都必须可达
+				return IsCanReach(Vec2(current.row, target.col), query)
+					&& IsCanReach(Vec2(target.row, current.col), query)
+					&& query(target);
+			}
+		}
+
+		return false;
+	}
+
+	template <typename Query>
+	inline bool AStar::IsWalkable(int row, int col, Query &query)
+	{
+		return row >= 0 && col >= 0 && row < total_row_ && col < total_col_
+			&& query(Vec2(static_cast<unsigned short>(row), static_cast<unsigned short>(col)));
+	}
+
+	template <typename Query>
+	bool AStar::Jump(const Vec2 &from, int row_dir, int col_dir, const Vec2 &end_point, Query &query, Vec2 &out)
+	{
+		int row = from.row;
+		int col = from.col;
+		for (;;)
+		{
+			// 斜向移动时两侧的格子都必须可达
+			if (row_dir != 0 && col_dir != 0
+				&& (!IsWalkable(row + row_dir, col, query) || !IsWalkable(row, col + col_dir, query)))
+			{
+				return false;
+			}
+
+			row += row_dir;
+			col += col_dir;
+			if (!IsWalkable(row, col, query))
+			{
+				return false;
+			}
+
+			out(static_cast<unsigned short>(row), static_cast<unsigned short>(col));
+			if (out == end_point)
+			{
+				return true;
+			}
+
+			Vec2 unused;
+			if (row_dir != 0 && col_dir != 0)
+			{
+				// 斜向移动时，横向或纵向能找到跳点则当前格子为跳点
+				if (Jump(out, row_dir, 0, end_point, query, unused) || Jump(out, 0, col_dir, end_point, query, unused))
+				{
+					return true;
+				}
+			}
+			else if (row_dir == 0)
+			{
+				// 横向移动，检查强制邻居
+				if ((IsWalkable(row - 1, col, query) && !IsWalkable(row - 1, col - col_dir, query))
+					|| (IsWalkable(row + 1, col, query) && !IsWalkable(row + 1, col - col_dir, query)))
+				{
+					return true;
+				}
+			}
+			else
+			{
+				// 纵向移动，检查强制邻居
+				if ((IsWalkable(row, col - 1, query) && !IsWalkable(row - row_dir, col - 1, query))
+					|| (IsWalkable(row, col + 1, query) && !IsWalkable(row - row_dir, col + 1, query)))
+				{
+					return true;
+				}
+
+				// 四方向移动时只能在纵向线段上转弯，需要检查横向的跳点
+				if (!allow_corner_
+					&& (Jump(out, 0, 1, end_point, query, unused) || Jump(out, 0, -1, end_point, query, unused)))
+				{
+					return true;
+				}
+			}
+		}
+	}
+
+	template <typename Query>
+	void AStar::ExpandJumpPoints(Node *current, const Vec2 &end_point, Query &query)
+	{
+		int directions[8][2];
+		int count = 0;
+		const Vec2 pos = current->pos;
+		if (current->parent == nullptr)
+		{
+			for (int row_dir = -1; row_dir <= 1; ++row_dir)
+			{
+				for (int col_dir = -1; col_dir <= 1; ++col_dir)
+				{
+					if ((row_dir != 0 || col_dir != 0) && (allow_corner_ || row_dir == 0 || col_dir == 0))
+					{
+						directions[count][0] = row_dir;
+						directions[count][1] = col_dir;
+						++count;
+					}
+				}
+			}
+		}
+		else
+		{
+			const Vec2 &parent = current->parent->pos;
+			const int row_dir = (pos.row > parent.row) - (pos.row < parent.row);
+			const int col_dir = (pos.col > parent.col) - (pos.col < parent.col);
+			if (row_dir != 0 && col_dir != 0)
+			{
+				const int natural[3][2] = { { row_dir, 0 }, { 0, col_dir }, { row_dir, col_dir } };
+				memcpy(directions, natural, sizeof(natural));
+				count = 3;
+			}
+			else
+			{
+				// 前进方向、两侧方向，以及允许斜向时的前方两个斜向
+				const int side_row = col_dir != 0 ? 1 : 0;
+				const int side_col = row_dir != 0 ? 1 : 0;
+				const int natural[5][2] = {
+					{ row_dir, col_dir },
+					{ side_row, side_col },
+					{ -side_row, -side_col },
+					{ row_dir + side_row, col_dir + side_col },
+					{ row_dir - side_row, col_dir - side_col },
+				};
+				count = allow_corner_ ? 5 : 3;
+				memcpy(directions, natural, sizeof(int) * 2 * count);
+			}
+		}
+
+		for (int i = 0; i < count; ++i)
+		{
+			Vec2 target;
+			if (!Jump(pos, directions[i][0], directions[i][1], end_point, query, target) || HasNodeInCloseList(target))
+			{
+				continue;
+			}
+
+			Node *node = nullptr;
+			if (HasNodeInOpenList(target, node))
+			{
+				HandleFoundNode(current, node);
+			}
+			else
+			{
+				HandleNotFoundNode(current, GetNode(target), end_point);
+			}
+		}
+	}
+
+	template <typename Query>
+	Node* AStar::SearchImpl(const SearchParam &param, Query &query)
+	{
+		if (InvalidParam(param))
+		{
+			Clear();
+			throw std::runtime_error("invalid param!");
+		}
+
+		Init(param);
+
+		PushOpenList(GetNode(param.start_point));
+
+		while (!IsOpenListEmpty())
+		{
+			// 启发函数一致，终点出列时的路径为最短路径
+			Node *current_node = PopOpenList();
+			const Vec2 current = current_node->pos;
+			if (current == param.end_point)
+			{
+				return current_node;
+			}
+
+			if (param.jump_point)
+			{
+				ExpandJumpPoints(current_node, param.end_point, query);
+				continue;
+			}
+
+			// 依次检查周围的格子，越界的坐标回绕为很大的无符号数，由 IsCanReach 排除
+			for (int row = current.row - 1; row <= current.row + 1; ++row)
+			{
+				for (int col = current.col - 1; col <= current.col + 1; ++col)
+				{
+					const Vec2 target(static_cast<unsigned short>(row), static_cast<unsigned short>(col));
+					if (!IsCanReach(current, target, param.allow_corner, query))
+					{
+						continue;
+					}
+
+					Node *new_node = nullptr;
+					if (HasNodeInOpenList(target, new_node))
+					{
+						HandleFoundNode(current_node, new_node);
+					}
+					else
+					{
+						HandleNotFoundNode(current_node, GetNode(target), param.end_point);
+					}
+				}
+			}
+		}
+
+		return nullptr;
+	}
+
+	template <typename Query>
+	int AStar::SearchDistance(const SearchParam &param, Query is_can_reach)
+	{
+		Node *node = SearchImpl(param, is_can_reach);
+		const int steps = node ? CountSteps(node) : -1;
+		Clear();
+		return steps;
+	}
+
+	template <typename Query>
+	int AStar::SearchPath(const SearchParam &param, Query is_can_reach, Vec2 *out, size_t capacity)
+	{
+		int steps = -1;
+		Node *node = SearchImpl(param, is_can_reach);
+		if (node)
+		{
+			steps = CountSteps(node);
+			FillPath(node, steps, out, capacity);
+		}
+		Clear();
+		return steps;
+	}
 }
\ No newline at end of file
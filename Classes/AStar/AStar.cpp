@@ -1,53 +1,21 @@
 ﻿#include "AStar.h"
 
 #include <cassert>
+#include <cstdlib>
+#include <stdexcept>
 #include <algorithm>
-#include "../Misc/BlockAllocator.h"
 
 namespace a_star
 {
 	/************************************************************************/
 
-	/* Node state */
-	enum
-	{
-		NOTEXIST,
-		IN_OPENLIST,
-		IN_CLOSELIST
-	};
-
-	const int kStep = 10;
-	const int kOblique = 14;
-
-	struct Node
-	{
-		unsigned short	g;
-		unsigned short	h;
-		Vec2			pos;
-		int				state;
-		Node*			parent;
-
-		int f() const { return g + h; }
-
-		inline Node(const Vec2 &pos) : g(0), h(0), pos(pos), parent(nullptr), state(NOTEXIST) {}
-
-		void* operator new(std::size_t size)
-		{
-			return SOA::GetInstance()->Allocate(size);
-		}
-
-			void operator delete(void* p) throw()
-		{
-			if (p) SOA::GetInstance()->Free(p, sizeof(Node));
-		}
-	};
-
 	inline bool CompHeap(const Node *a, const Node *b)
 	{
 #ifdef _DEBUG
 		assert(a && b);
 #endif
-		return a->f() > b->f();
+		// f 相同时优先扩展离终点更近的节点
+		return a->f() > b->f() || (a->f() == b->f() && a->h > b->h);
 	}
 
 	/************************************************************************/
@@ -56,7 +24,12 @@ namespace a_star
 		: map_size_(0)
 		, total_row_(0)
 		, total_col_(0)
-		, query_func_(nullptr)
+		, queue_type_(BINARY_HEAP)
+		, allow_corner_(false)
+		, generation_(0)
+		, bucket_min_(0)
+		, bucket_max_(0)
+		, bucket_size_(0)
 	{
 	}
 
@@ -65,39 +38,53 @@ namespace a_star
 
 	}
 
-	void AStar::Init(const AStarParam &param)
+	void AStar::Init(const SearchParam &param)
 	{
 		total_row_ = param.total_row;
 		total_col_ = param.total_col;
-		query_func_ = param.is_can_reach;
+		queue_type_ = param.queue_type;
+		allow_corner_ = param.allow_corner;
 		map_size_ = total_row_ * total_col_;
 
-		if (!maps_index_.empty())
+		if (nodes_.size() < map_size_)
 		{
-			memset(&maps_index_[0], 0, sizeof(Node *) * maps_index_.size());
+			nodes_.resize(map_size_);
 		}
-		maps_index_.resize(map_size_, nullptr);
-	}
 
-	void AStar::Clear()
-	{
-		unsigned int index = 0;
-		while (index < map_size_)
+		// 代数回绕时才需要清理全部节点
+		if (++generation_ == 0)
 		{
-			delete maps_index_[index++];
+			for (size_t i = 0; i < nodes_.size(); ++i)
+			{
+				nodes_[i].generation = 0;
+			}
+			generation_ = 1;
 		}
+	}
 
+	void AStar::Clear()
+	{
 		map_size_ = 0;
 		total_row_ = 0;
 		total_col_ = 0;
 		open_list_.resize(0);
-		query_func_ = nullptr;
+
+		// 只清理使用过的桶，保留已分配的内存
+		if (bucket_max_ >= bucket_min_ && !buckets_.empty())
+		{
+			for (unsigned int f = bucket_min_; f <= bucket_max_ && f < buckets_.size(); ++f)
+			{
+				buckets_[f].clear();
+			}
+		}
+		bucket_min_ = 0;
+		bucket_max_ = 0;
+		bucket_size_ = 0;
 	}
 
-	bool AStar::InvalidParam(const AStarParam &param)
+	bool AStar::InvalidParam(const SearchParam &param)
 	{
-		return (!param.is_can_reach
-				|| (param.total_col < 0 || param.total_row < 0)
+		return ((param.total_col < 0 || param.total_row < 0)
 				|| (param.start_point.col < 0 || param.start_point.col >= param.total_col)
 				|| (param.start_point.row < 0 || param.start_point.row >= param.total_row)
 				|| (param.end_point.col < 0 || param.end_point.col >= param.total_col)
@@ -105,117 +92,156 @@ namespace a_star
 				);
 	}
 
-	inline bool AStar::HasNodeInOpenList(const Vec2 &point, Node *&out)
+	inline unsigned int AStar::CalculG(Node *parent, const Vec2 &current)
 	{
-		out = maps_index_[point.row * total_row_ + point.col];
-		return out ? out->state == IN_OPENLIST : false;
+#ifdef _DEBUG
+		assert(parent);
+#endif
+		// 跳点搜索时两点之间为直线或斜线，按对角距离计算
+		const unsigned int row_offset = abs(current.row - parent->pos.row);
+		const unsigned int col_offset = abs(current.col - parent->pos.col);
+		const unsigned int oblique = std::min(row_offset, col_offset);
+		return parent->g + oblique * kOblique + (row_offset + col_offset - oblique * 2) * kStep;
 	}
 
-	inline bool AStar::HasNodeInCloseList(const Vec2 &point)
+	inline unsigned int AStar::CalculH(const Vec2 &current, const Vec2 &end_point)
 	{
-		Node *node_ptr = maps_index_[point.row * total_row_ + point.col];
-		return node_ptr ? node_ptr->state == IN_CLOSELIST : false;
+		// 四方向为曼哈顿距离，八方向为对角距离，保证启发函数一致
+		const unsigned int row_offset = abs(end_point.row - current.row);
+		const unsigned int col_offset = abs(end_point.col - current.col);
+		if (!allow_corner_)
+		{
+			return (row_offset + col_offset) * kStep;
+		}
+		const unsigned int oblique = std::min(row_offset, col_offset);
+		return oblique * kOblique + (row_offset + col_offset - oblique * 2) * kStep;
 	}
 
-	bool AStar::IsCanReach(const Vec2 &point)
+	bool AStar::IsOpenListEmpty() const
 	{
-		return (point.col >= 0 && point.col < total_col_ && point.row >= 0 && point.row < total_row_) ? query_func_(point) : false;
+		return queue_type_ == BUCKET_QUEUE ? bucket_size_ == 0 : open_list_.empty();
 	}
 
-	bool AStar::IsCanReach(const Vec2 &current, const Vec2 &target, bool allow_corner)
+	void AStar::PushOpenList(Node *node)
 	{
-		if (target.col >= 0 && target.col < total_col_ && target.row >= 0 && target.row < total_row_)
+		node->state = IN_OPENLIST;
+		if (queue_type_ == BUCKET_QUEUE)
 		{
-			if (HasNodeInCloseList(target)) return false;
-			if (abs(current.row + current.col - target.row - target.col) == 1)
+			const unsigned int f = node->f();
+			if (f >= buckets_.size())
 			{
-				return query_func_(target);
+				buckets_.resize(f + 1);
 			}
-			else if (allow_corner)
-			{
-				return (IsCanReach(Vec2(current.col + target.col - current.col, current.row))
-						&& IsCanReach(Vec2(current.col, current.row + target.row - current.row)));
-			}
-		}	
-
-		return false;
+			if (bucket_size_++ == 0 || f < bucket_min_) bucket_min_ = f;
+			if (f > bucket_max_) bucket_max_ = f;
+			buckets_[f].push_back(node);
+		}
+		else
+		{
+			node->heap_index = open_list_.size();
+			open_list_.push_back(node);
+			PercolateUp(node->heap_index);
+		}
 	}
 
-	void AStar::SearchCanReachThePosition(const Vec2 &current, bool allow_corner, std::vector<Vec2> &can_each_pos)
+	Node* AStar::PopOpenList()
 	{
-		Vec2 target;
-		can_each_pos.clear();
-
-		int row_index = current.row - 1;
-		const int max_row = current.row + 1;
-		const int max_col = current.col + 1;
-
-		while (row_index <= max_row)
+		Node *current_node = nullptr;
+		if (queue_type_ == BUCKET_QUEUE)
 		{
-			int col_index = current.col - 1;
-			while (col_index <= max_col)
+			for (;;)
 			{
-				if (IsCanReach(current, target(row_index, col_index), allow_corner))
+				std::vector<Node *> &bucket = buckets_[bucket_min_];
+				if (bucket.empty())
 				{
-					can_each_pos.push_back(target);
+					++bucket_min_;
+					continue;
+				}
+
+				// 后进先出，跳过 g 值更新后留下的过期项
+				current_node = bucket.back();
+				bucket.pop_back();
+				if (current_node->state == IN_OPENLIST && static_cast<unsigned int>(current_node->f()) == bucket_min_)
+				{
+					break;
 				}
-				++col_index;
 			}
-			++row_index;
+			--bucket_size_;
 		}
+		else
+		{
+			current_node = open_list_.front();
+			open_list_.front() = open_list_.back();
+			open_list_.front()->heap_index = 0;
+			open_list_.pop_back();
+			if (!open_list_.empty())
+			{
+				PercolateDown(0);
+			}
+			current_node->heap_index = -1;
+		}
+		current_node->state = IN_CLOSELIST;
+		return current_node;
 	}
 
-	inline unsigned int AStar::CalculG(Node *parent, const Vec2 &current)
-	{
-#ifdef _DEBUG
-		assert(parent);
-#endif
-		unsigned int g_value = ((abs(current.row + current.col - parent->pos.row - parent->pos.col)) == 2 ? kOblique : kStep);
-		return g_value += parent->g;
-	}
-
-	inline unsigned int AStar::CalculH(const Vec2 &current, const Vec2 &end_point)
+	void AStar::DecreaseKey(Node *node)
 	{
-		unsigned int h_value = abs(end_point.row + end_point.col - current.row - current.col);
-		return h_value * kStep;
+		if (queue_type_ == BUCKET_QUEUE)
+		{
+			// 旧的项留在原来的桶中，取出时跳过
+			const unsigned int f = node->f();
+			if (f < bucket_min_) bucket_min_ = f;
+			buckets_[f].push_back(node);
+		}
+		else
+		{
+			PercolateUp(node->heap_index);
+		}
 	}
 
-	int AStar::GetNodeIndex(Node *node)
+	void AStar::PercolateUp(int hole)
 	{
-#ifdef _DEBUG
-		assert(node);
-#endif
-		unsigned int index = 0;
-		const unsigned int size = open_list_.size();
-
-		while (index < size)
+		Node *node = open_list_[hole];
+		while (hole > 0)
 		{
-			if (open_list_[index]->pos == node->pos)
+			const int parent = (hole - 1) / 2;
+			if (!CompHeap(open_list_[parent], node))
 			{
-				return index;
+				break;
 			}
-			++index;
+			open_list_[hole] = open_list_[parent];
+			open_list_[hole]->heap_index = hole;
+			hole = parent;
 		}
-		std::abort();
-		return -1;
+		open_list_[hole] = node;
+		node->heap_index = hole;
 	}
 
-	void AStar::PercolateUp(int hole)
+	void AStar::PercolateDown(int hole)
 	{
-		unsigned int parent = 0;
-		while (hole > 1)
+		Node *node = open_list_[hole];
+		const int size = open_list_.size();
+		for (;;)
 		{
-			parent = (hole - 1) / 2;
-			if (open_list_[hole]->f() < open_list_[parent]->f())
+			int child = hole * 2 + 1;
+			if (child >= size)
 			{
-				std::swap(open_list_[hole], open_list_[parent]);
-				hole = parent;
+				break;
 			}
-			else
+			if (child + 1 < size && CompHeap(open_list_[child], open_list_[child + 1]))
 			{
-				return;
+				++child;
 			}
+			if (!CompHeap(node, open_list_[child]))
+			{
+				break;
+			}
+			open_list_[hole] = open_list_[child];
+			open_list_[hole]->heap_index = hole;
+			hole = child;
 		}
+		open_list_[hole] = node;
+		node->heap_index = hole;
 	}
 
 	void AStar::HandleFoundNode(Node *current, Node *target)
@@ -228,7 +254,7 @@ namespace a_star
 		{
 			target->g = g_value;
 			target->parent = current;
-			PercolateUp(GetNodeIndex(target));
+			DecreaseKey(target);
 		}
 	}
 
@@ -240,79 +266,56 @@ namespace a_star
 		target->parent = current;
 		target->g = CalculG(current, target->pos);
 		target->h = CalculH(target->pos, end_point);
-
-		Node *&node_ptr = maps_index_[target->pos.row * total_row_ + target->pos.col];
-		node_ptr = target;
-		node_ptr->state = IN_OPENLIST;
-
-		open_list_.push_back(target);
-		std::push_heap(open_list_.begin(), open_list_.end(), CompHeap);
+		PushOpenList(target);
 	}
 
-	std::vector<Vec2> AStar::Search(const AStarParam &param)
+	int AStar::CountSteps(Node *node)
 	{
-		std::vector<Vec2> search_path;
-		if (!InvalidParam(param))
+		int steps = 0;
+		for (; node->parent; node = node->parent)
 		{
-			Init(param);
-
-			std::vector<Vec2> around_node_pos;
-			around_node_pos.reserve(param.allow_corner ? 8 : 4);
-
-			Node *start_node = new Node(param.start_point);
-			open_list_.push_back(start_node);
-
-			Node *&node_ptr = maps_index_[start_node->pos.row * total_row_ + start_node->pos.col];
-			node_ptr = start_node;
-			node_ptr->state = IN_OPENLIST;
+			const Vec2 &parent = node->parent->pos;
+			steps += std::max(abs(node->pos.row - parent.row), abs(node->pos.col - parent.col));
+		}
+		return steps;
+	}
 
-			while (!open_list_.empty())
+	void AStar::FillPath(Node *node, int steps, Vec2 *out, size_t capacity)
+	{
+		int index = steps;
+		for (; node->parent; node = node->parent)
+		{
+			const Vec2 &parent = node->parent->pos;
+			const int row_dir = (node->pos.row > parent.row) - (node->pos.row < parent.row);
+			const int col_dir = (node->pos.col > parent.col) - (node->pos.col < parent.col);
+			Vec2 point = node->pos;
+			while (!(point == parent))
 			{
-				Node *current_node = *open_list_.begin();
-				std::pop_heap(open_list_.begin(), open_list_.end(), CompHeap);
-				open_list_.pop_back();
-				maps_index_[current_node->pos.row * total_row_ + current_node->pos.col]->state = IN_CLOSELIST;
-
-				SearchCanReachThePosition(current_node->pos, param.allow_corner, around_node_pos);
-
-				unsigned int index = 0;
-				const unsigned int size = around_node_pos.size();
-
-				while (index < size)
+				if (static_cast<size_t>(--index) < capacity)
 				{
-					Node *new_node = nullptr;
-					if (HasNodeInOpenList(around_node_pos[index], new_node))
-					{
-						HandleFoundNode(current_node, new_node);
-					}
-					else
-					{
-						new_node = new Node(around_node_pos[index]);
-						HandleNotFoundNode(current_node, new_node, param.end_point);
-
-						if (around_node_pos[index] == param.end_point)
-						{
-							while (new_node->parent)
-							{
-								search_path.push_back(new_node->pos);
-								new_node = new_node->parent;
-							}
-							std::reverse(search_path.begin(), search_path.end());
-							goto __END__;
-						}
-					}
-					++index;
+					out[index] = point;
 				}
+				point(static_cast<unsigned short>(point.row - row_dir), static_cast<unsigned short>(point.col - col_dir));
 			}
-		__END__:
-			Clear();
 		}
-		else
+	}
+
+	std::vector<Vec2> AStar::Search(const AStarParam &param)
+	{
+		if (!param.is_can_reach)
 		{
 			Clear();
 			throw std::runtime_error("invalid param!");
 		}
 
+		std::vector<Vec2> search_path;
+		Node *node = SearchImpl(param, param.is_can_reach);
+		if (node && node->parent)
+		{
+			search_path.resize(CountSteps(node));
+			FillPath(node, search_path.size(), &search_path[0], search_path.size());
+		}
+		Clear();
 		return search_path;
 	}
 }
\ No newline at end of file
@@ -1,33 +1,84 @@
 ﻿#include "Backend.h"
 
+#include <random>
 #include <cassert>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
 #include <algorithm>
 
 Backend::Backend(BackendDelegate *delegate)
 	: initialized_(false)
 	, delegate_(delegate)
-	, generator_(std::random_device()())
+	, seed_(0)
+	, stream_(0)
+	, engine_(&default_engine_)
+	, frist_line_(0)
 {
 	assert(delegate_);
+
+	// 未指定种子时使用不确定的种子
+	std::random_device device;
+	SetSeed((uint64_t(device()) << 32) | device());
+}
+
+// 设置随机种子
+void Backend::SetSeed(uint64_t seed, uint64_t stream)
+{
+	seed_ = seed;
+	stream_ = stream;
+	default_engine_.Seed(seed, stream);
+}
+
+// 替换随机数发生器
+void Backend::SetRandomEngine(RandomEngine *engine)
+{
+	engine_ = engine ? engine : &default_engine_;
 }
 
 // 设置地图
 void Backend::SetMap(const MapConfig &config)
 {
-	if (config.data.size() == config.width * config.height)
+	// 先检查全部输入，失败时保持之前的地图不变
+	if (config.width > MAX_MAP_COLS || config.height > MAX_MAP_ROWS)
+	{
+		throw std::runtime_error("map is too large!");
+	}
+
+	if (config.type_quantity > INT8_MAX)
 	{
-		config_ = config;
-		sprites_.clear();
-		moved_sprites_.clear();
-		souch_scope_.init();
-		initialized_ = true;
-		ReGeneration();
-		VisitMap();
+		throw std::runtime_error("too many sprite types!");
 	}
-	else
+
+	if (config.width <= 0 || config.height <= 0 || config.type_quantity <= 0
+		|| config.data.size() != static_cast<size_t>(config.width * config.height))
 	{
 		throw std::runtime_error("Invalid map configuration!");
 	}
+
+	config_ = config;
+	state_.moved_sprites.clear();
+	state_.souch_scope.init();
+	bit_board_.Reset(config.height, config.width, config.type_quantity);
+	BuildRefillDistance();
+	cell_tracks_.assign(config.width * config.height, -1);
+	random_buffer_.assign(config.width, 0);
+
+	// 获取首行
+	frist_line_ = 0;
+	for (int idx = 0; idx < config_.width * config_.height; ++idx)
+	{
+		if (config_.data[idx])
+		{
+			frist_line_ = idx / config_.width;
+			break;
+		}
+	}
+
+	initialized_ = true;
+	ReGeneration();
+	VisitMap();
 }
 
 // 获取地图宽度
@@ -50,11 +101,80 @@ int Backend::GetMapHeight() const
 	return config_.height;
 }
 
+// 计算棋盘哈希值
+uint64_t Backend::GetBoardHash() const
+{
+	if (!initialized_)
+	{
+		throw std::runtime_error("map configuration is not set!");
+	}
+
+	uint64_t hash = 14695981039346656037ull;
+	for (int idx = 0; idx < config_.width * config_.height; ++idx)
+	{
+		hash = (hash ^ static_cast<uint8_t>(state_.sprites[idx])) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// 导出棋盘
+void Backend::StoreSprites(uint8_t *out) const
+{
+	if (!initialized_)
+	{
+		throw std::runtime_error("map configuration is not set!");
+	}
+
+	for (int idx = 0; idx < config_.width * config_.height; ++idx)
+	{
+		out[idx] = static_cast<uint8_t>(state_.sprites[idx]);
+	}
+}
+
+// 导入棋盘
+void Backend::LoadSprites(const uint8_t *in)
+{
+	if (!initialized_)
+	{
+		throw std::runtime_error("map configuration is not set!");
+	}
+
+	for (int idx = 0; idx < config_.width * config_.height; ++idx)
+	{
+		state_.sprites[idx] = static_cast<int8_t>(in[idx]);
+	}
+	state_.moved_sprites.clear();
+	state_.souch_scope.init();
+}
+
+// 快照所需的字节数
+size_t Backend::GetSnapshotSize() const
+{
+	if (!initialized_)
+	{
+		throw std::runtime_error("map configuration is not set!");
+	}
+	return offsetof(State, sprites) + sizeof(state_.sprites[0]) * config_.width * config_.height;
+}
+
+// 保存可变状态
+void Backend::Snapshot(void *out)
+{
+	state_.random = default_engine_.GetState();
+	memcpy(out, &state_, GetSnapshotSize());
+}
+
+// 恢复可变状态
+void Backend::Restore(const void *in)
+{
+	memcpy(&state_, in, GetSnapshotSize());
+	default_engine_.SetState(state_.random);
+}
+
 // 取随机数
 int Backend::Random(const int min, const int max)
 {
-	std::uniform_int_distribution<> dis(min, max);
-	return dis(generator_);
+	return min + static_cast<int>(engine_->Bounded(static_cast<uint32_t>(max - min + 1)));
 }
 
 // 精灵是否相邻
@@ -81,56 +201,161 @@ bool Backend::IsSameType(const MapIndex &a, const MapIndex &b)
 		throw std::runtime_error("invalid element index!");
 	}
 
-	return sprites_[a.row * config_.width + a.col] == sprites_[b.row * config_.width + b.col];
+	return state_.sprites[a.row * config_.width + a.col] == state_.sprites[b.row * config_.width + b.col];
 }
 
-// 计算最短距离
-int Backend::CalculateShortest(const MapIndex &index)
+// 计算补充距离场
+void Backend::BuildRefillDistance()
 {
-	// 求最短距离
-	std::vector<int> heap;
+	// 从首行所有有效格出发的多源广度优先搜索，等价于对每个首行有效列求最短路径后取最小值
+	const int max_size = config_.width * config_.height;
+	refill_distance_.assign(max_size, ~0);
+
+	std::vector<int> queue;
+	queue.reserve(max_size);
 	for (int col = 0; col < config_.width; ++col)
 	{
 		if (config_.data[col])
 		{
-			a_star::AStarParam param;
-			param.start_point.row = 0;
-			param.start_point.col = col;
-			param.end_point.row = index.row;
-			param.end_point.col = index.col;
-			param.total_row = config_.height;
-			param.total_col = config_.width;
-			param.is_can_reach = [&](const a_star::Vec2 &point)
-			{
-				return config_.data[point.row * config_.width + point.col];
-			};
+			refill_distance_[col] = 0;
+			queue.push_back(col);
+		}
+	}
 
-			int distance = a_star_.Search(param).size();
-			if (distance > 0)
+	for (size_t head = 0; head < queue.size(); ++head)
+	{
+		const int idx = queue[head];
+		const int row = idx / config_.width;
+		const int col = idx % config_.width;
+		const int around[4] =
+		{
+			row > 0 ? idx - config_.width : -1,
+			row + 1 < config_.height ? idx + config_.width : -1,
+			col > 0 ? idx - 1 : -1,
+			col + 1 < config_.width ? idx + 1 : -1,
+		};
+
+		for (auto next : around)
+		{
+			if (next >= 0 && config_.data[next] && refill_distance_[next] == ~0)
 			{
-				heap.push_back(distance);
-				std::push_heap(heap.begin(), heap.end(), [](int a, int b)->bool
-				{
-					return a > b;
-				});
+				refill_distance_[next] = refill_distance_[idx] + 1;
+				queue.push_back(next);
 			}
 		}
 	}
-	return heap.size() > 0 ? heap[0] : ~0;
+}
+
+// 计算最短距离
+int Backend::CalculateShortest(const MapIndex &index)
+{
+	return refill_distance_[index.row * config_.width + index.col];
 }
 
 // 重新生成地图
-void Backend::ReGeneration()
+bool Backend::ReGeneration()
 {
 	if (!initialized_)
 	{
 		throw std::runtime_error("map configuration is not set!");
 	}
 
-	for (int idx = 0; idx < config_.width * config_.height; ++idx)
+	const int width = config_.width;
+	const int size = config_.width * config_.height;
+	std::fill_n(state_.sprites, size, NOTHING);
+
+	// 行优先填充，每个格子只需检查左侧和上方已填好的两个格子
+	bool planted = false;
+	for (int idx = 0; idx < size; ++idx)
+	{
+		// 埋设可消除的交换时已提前填好
+		if (!config_.data[idx] || state_.sprites[idx] != NOTHING)
+		{
+			continue;
+		}
+
+		const int row = idx / width;
+		const int col = idx % width;
+		const int excluded_h = col >= 2 ? GetPairType(idx - 1, 1) : NOSPRITE;
+		const int excluded_v = row >= 2 ? GetPairType(idx - width, width) : NOSPRITE;
+
+		if (!planted && row >= 1 && col + 2 < width && config_.data[idx + 1] && config_.data[idx + 2])
+		{
+			// 形式一: 本格与右侧格子填入右上角的类型，右上角与其下方交换后成三连
+			//   . . t
+			//   t t x
+			const int corner = state_.sprites[idx + 2 - width];
+			if (corner > 0 && corner != excluded_h && corner != excluded_v
+				&& (col < 1 || state_.sprites[idx - 1] != corner)
+				&& (row < 2 || GetPairType(idx + 1 - width, width) != corner))
+			{
+				state_.sprites[idx] = corner;
+				state_.sprites[idx + 1] = corner;
+				planted = true;
+				continue;
+			}
+
+			// 形式二: 右侧两个格子填入正上方的类型，正上方与本格交换后成三连
+			//   t . .
+			//   x t t
+			const int above = state_.sprites[idx - width];
+			if (above > 0
+				&& GetPairType(idx + 1 - width, width) != above
+				&& GetPairType(idx + 2 - width, width) != above)
+			{
+				const int type = RandomTypeExcept(excluded_h, excluded_v, above);
+				if (type != NOSPRITE)
+				{
+					state_.sprites[idx] = type;
+					state_.sprites[idx + 1] = above;
+					state_.sprites[idx + 2] = above;
+					planted = true;
+					continue;
+				}
+			}
+		}
+
+		int type = RandomTypeExcept(excluded_h, excluded_v, NOSPRITE);
+		if (type == NOSPRITE)
+		{
+			// 类型数量不足时无法避免三连
+			type = Random(1, config_.type_quantity);
+		}
+		state_.sprites[idx] = type;
+	}
+	return planted;
+}
+
+// 向前两个格子类型相同时返回该类型
+int Backend::GetPairType(int idx, int step) const
+{
+	const int type = state_.sprites[idx];
+	return type > 0 && state_.sprites[idx - step] == type ? type : NOSPRITE;
+}
+
+// 在排除指定类型后随机选取类型
+int Backend::RandomTypeExcept(int a, int b, int c)
+{
+	int allowed = 0;
+	for (int type = 1; type <= config_.type_quantity; ++type)
+	{
+		if (type != a && type != b && type != c) ++allowed;
+	}
+
+	if (allowed == 0)
+	{
+		return NOSPRITE;
+	}
+
+	int nth = static_cast<int>(engine_->Bounded(static_cast<uint32_t>(allowed)));
+	for (int type = 1; type <= config_.type_quantity; ++type)
 	{
-		sprites_.push_back(config_.data[idx] ? Random(1, config_.type_quantity) : NOTHING);
+		if (type != a && type != b && type != c && nth-- == 0)
+		{
+			return type;
+		}
 	}
+	return NOSPRITE;
 }
 
 // 有效精灵索引
@@ -143,7 +368,7 @@ bool Backend::IsValidSprite(const MapIndex &index)
 
 	if (index.col >= 0 && index.row >= 0 && index.col < config_.width && index.row < config_.height)
 	{
-		int type = sprites_[index.row * config_.width + index.col];
+		int type = state_.sprites[index.row * config_.width + index.col];
 		return (type != NOTHING) && (type != NOSPRITE);
 	}
 	return false;
@@ -160,7 +385,7 @@ void Backend::VisitMap()
 	const size_t max_size = config_.width * config_.height;
 	for (size_t idx = 0; idx < max_size; ++idx)
 	{
-		delegate_->OnRefreshMap(MapIndex(idx / config_.width, idx % config_.width), sprites_[idx]);
+		delegate_->OnRefreshMap(MapIndex(idx / config_.width, idx % config_.width), state_.sprites[idx]);
 	}
 }
 
@@ -172,17 +397,17 @@ void Backend::SwapSprite(const MapIndex &a, const MapIndex &b)
 		throw std::runtime_error("map configuration is not set!");
 	}
 
-	souch_scope_.init();
+	state_.souch_scope.init();
 
 	if (!IsValidSprite(a) || !IsValidSprite(b))
 	{
 		throw std::runtime_error("invalid element index!");
 	}
-	std::swap(sprites_[a.row * config_.width + a.col], sprites_[b.row * config_.width + b.col]);
+	std::swap(state_.sprites[a.row * config_.width + a.col], state_.sprites[b.row * config_.width + b.col]);
 }
 
 // 移动过的是否可消除精灵
-bool Backend::GetMovedSpriteAndCanEliminate(std::set<MapIndex> &out)
+bool Backend::GetMovedSpriteAndCanEliminate(CellSet &out)
 {
 	if (!initialized_)
 	{
@@ -190,10 +415,10 @@ bool Backend::GetMovedSpriteAndCanEliminate(std::set<MapIndex> &out)
 	}
 
 	out.clear();
-	std::set<MapIndex> eliminate_set;
-	for (auto &index : moved_sprites_)
+	CellSet eliminate_set;
+	for (auto &index : state_.moved_sprites)
 	{
-		if (sprites_[index.row * config_.width + index.col] > NOSPRITE && IsCanEliminate(index, eliminate_set))
+		if (state_.sprites[index.row * config_.width + index.col] > NOSPRITE && IsCanEliminate(index, eliminate_set))
 		{
 			for (auto can_eliminate_index : eliminate_set)
 			{
@@ -201,12 +426,61 @@ bool Backend::GetMovedSpriteAndCanEliminate(std::set<MapIndex> &out)
 			}		
 		}
 	}
-	moved_sprites_.clear();
+	state_.moved_sprites.clear();
 	return out.empty() == false;
 }
 
-// 是否可消除
-bool Backend::IsCanEliminate(const MapIndex &index, std::set<MapIndex> &out)
+// 沿一个方向统计同类型精灵
+int Backend::CountSameType(int row, int col, int row_step, int col_step, int type) const
+{
+	int count = 0;
+	for (int step = 1; step <= 2; ++step)
+	{
+		const int r = row + row_step * step;
+		const int c = col + col_step * step;
+		if (r < 0 || r >= config_.height || c < 0 || c >= config_.width || state_.sprites[r * config_.width + c] != type)
+		{
+			break;
+		}
+		++count;
+	}
+	return count;
+}
+
+// 精灵移入格子后是否形成三连
+bool Backend::IsFormLine(int row, int col, int row_step, int col_step, int type) const
+{
+	// 交换对象所在方向上的格子是对方原来的精灵，类型不同，因此只需统计其余三个方向
+	const int left = col_step == -1 ? 0 : CountSameType(row, col, 0, -1, type);
+	const int right = col_step == 1 ? 0 : CountSameType(row, col, 0, 1, type);
+	const int up = row_step == -1 ? 0 : CountSameType(row, col, -1, 0, type);
+	const int down = row_step == 1 ? 0 : CountSameType(row, col, 1, 0, type);
+	return left + right >= 2 || up + down >= 2;
+}
+
+// 交换后是否可以消除
+bool Backend::IsCanSwap(const MapIndex &a, const MapIndex &b)
+{
+	if (!IsValidSprite(a) || !IsValidSprite(b) || !IsAdjacent(a, b))
+	{
+		return false;
+	}
+
+	const int type_a = state_.sprites[a.row * config_.width + a.col];
+	const int type_b = state_.sprites[b.row * config_.width + b.col];
+	if (type_a == type_b)
+	{
+		return false;
+	}
+
+	const int row_step = b.row - a.row;
+	const int col_step = b.col - a.col;
+	return IsFormLine(a.row, a.col, row_step, col_step, type_b)
+		|| IsFormLine(b.row, b.col, -row_step, -col_step, type_a);
+}
+
+// 生成所有可以消除的交换
+unsigned int Backend::GenerateMoves(std::vector<SwapMove> &out)
 {
 	if (!initialized_)
 	{
@@ -214,52 +488,125 @@ bool Backend::IsCanEliminate(const MapIndex &index, std::set<MapIndex> &out)
 	}
 
 	out.clear();
-	if (IsValidSprite(index))
+	for (int row = 0; row < config_.height; ++row)
 	{
-		std::set<MapIndex> elements_set;
-		const int type = sprites_[index.row * config_.width + index.col];
-
-		// 横向遍历
 		for (int col = 0; col < config_.width; ++col)
 		{
-			const int idx = index.row * config_.width + col;
-			if (sprites_[idx] == type)
+			const int type = state_.sprites[row * config_.width + col];
+			if (type <= NOSPRITE)
 			{
-				elements_set.insert(MapIndex(index.row, col));
+				continue;
 			}
-			else
+
+			// 与右边交换
+			if (col + 1 < config_.width)
 			{
-				if (elements_set.size() >= 3 && (elements_set.find(index) != elements_set.end()))
+				const int right = state_.sprites[row * config_.width + col + 1];
+				if (right > NOSPRITE && right != type
+					&& (IsFormLine(row, col, 0, 1, right) || IsFormLine(row, col + 1, 0, -1, type)))
 				{
-					break;
+					out.push_back(SwapMove(MapIndex(row, col), MapIndex(row, col + 1)));
+				}
+			}
+
+			// 与下边交换
+			if (row + 1 < config_.height)
+			{
+				const int below = state_.sprites[(row + 1) * config_.width + col];
+				if (below > NOSPRITE && below != type
+					&& (IsFormLine(row, col, 1, 0, below) || IsFormLine(row + 1, col, -1, 0, type)))
+				{
+					out.push_back(SwapMove(MapIndex(row, col), MapIndex(row + 1, col)));
 				}
-				elements_set.clear();
 			}
 		}
-		if (elements_set.size() < 3) elements_set.clear();
+	}
+	return out.size();
+}
+
+// 是否存在可以消除的交换
+bool Backend::HasAnyMove()
+{
+	if (!initialized_)
+	{
+		throw std::runtime_error("map configuration is not set!");
+	}
 
-		// 纵向遍历
-		for (int row = 0; row < config_.height; ++row)
+	for (int row = 0; row < config_.height; ++row)
+	{
+		for (int col = 0; col < config_.width; ++col)
 		{
-			const int idx = row * config_.width + index.col;
-			if (sprites_[idx] == type)
+			if (IsCanSwap(MapIndex(row, col), MapIndex(row, col + 1))
+				|| IsCanSwap(MapIndex(row, col), MapIndex(row + 1, col)))
 			{
-				out.insert(MapIndex(row, index.col));
+				return true;
 			}
-			else
+		}
+	}
+	return false;
+}
+
+// 整盘可消除精灵
+bool Backend::GetAllCanEliminate(CellSet &out)
+{
+	if (!initialized_)
+	{
+		throw std::runtime_error("map configuration is not set!");
+	}
+
+	out.clear();
+
+	// 位棋盘不随交换、消除与落下更新，每次查询重建
+	bit_board_.Load(state_.sprites);
+	if (bit_board_.GetMatches(match_mask_))
+	{
+		bit_board_.Visit(match_mask_, [&](const MapIndex &index)
+		{
+			out.insert(index);
+		});
+	}
+	return out.empty() == false;
+}
+
+// 是否可消除
+bool Backend::IsCanEliminate(const MapIndex &index, CellSet &out)
+{
+	if (!initialized_)
+	{
+		throw std::runtime_error("map configuration is not set!");
+	}
+
+	out.clear();
+	if (IsValidSprite(index))
+	{
+		const int width = config_.width;
+		const int base = index.row * width;
+		const int type = state_.sprites[base + index.col];
+
+		// 横向延伸
+		int left = index.col;
+		int right = index.col;
+		while (left > 0 && state_.sprites[base + left - 1] == type) --left;
+		while (right + 1 < width && state_.sprites[base + right + 1] == type) ++right;
+		if (right - left + 1 >= 3)
+		{
+			for (int col = left; col <= right; ++col)
 			{
-				if (out.size() >= 3 && (out.find(index) != out.end()))
-				{
-					break;
-				}
-				out.clear();
+				out.insert(MapIndex(index.row, col));
 			}
 		}
-		if (out.size() < 3) out.clear();
 
-		for (auto &idx : elements_set)
+		// 纵向延伸
+		int top = index.row;
+		int bottom = index.row;
+		while (top > 0 && state_.sprites[(top - 1) * width + index.col] == type) --top;
+		while (bottom + 1 < config_.height && state_.sprites[(bottom + 1) * width + index.col] == type) ++bottom;
+		if (bottom - top + 1 >= 3)
 		{
-			out.insert(idx);
+			for (int row = top; row <= bottom; ++row)
+			{
+				out.insert(MapIndex(row, index.col));
+			}
 		}
 
 		return out.empty() == false;
@@ -267,7 +614,7 @@ bool Backend::IsCanEliminate(const MapIndex &index, std::set<MapIndex> &out)
 	return false;
 }
 
-bool Backend::IsCanEliminate(const MapIndex &previous, const MapIndex &current, std::set<MapIndex> &out)
+bool Backend::IsCanEliminate(const MapIndex &previous, const MapIndex &current, CellSet &out)
 {
 	if (!initialized_)
 	{
@@ -280,7 +627,7 @@ bool Backend::IsCanEliminate(const MapIndex &previous, const MapIndex &current,
 		return false;
 	}
 
-	std::set<MapIndex> elements_set;
+	CellSet elements_set;
 	IsCanEliminate(current, out);
 	IsCanEliminate(previous, elements_set);
 	for (auto &index : elements_set)
@@ -291,7 +638,7 @@ bool Backend::IsCanEliminate(const MapIndex &previous, const MapIndex &current,
 }
 
 // 执行消除
-unsigned int Backend::DoEliminate(std::set<MapIndex> &in_elements)
+unsigned int Backend::DoEliminate(CellSet &in_elements)
 {
 	if (!initialized_)
 	{
@@ -307,58 +654,55 @@ unsigned int Backend::DoEliminate(std::set<MapIndex> &in_elements)
 			throw std::runtime_error("invalid element index!");
 		}
 #endif
-		sprites_[index.row * config_.width + index.col] = NOSPRITE;
-		souch_scope_.update(index);
+		state_.sprites[index.row * config_.width + index.col] = NOSPRITE;
+		state_.souch_scope.update(index);
 		delegate_->OnEliminate(index, ++count, in_elements.size());
 	}
 	return count;
 }
 
 // 首行添加精灵
-unsigned int Backend::AddSpriteToFristLine(std::set<MapIndex> &out)
+unsigned int Backend::AddSpriteToFristLine(CellSet &out)
 {
 	if (!initialized_)
 	{
 		throw std::runtime_error("map configuration is not set!");
 	}
 
-	out.clear();
-	unsigned int count = 0;
-	const size_t max_size = config_.width * config_.height;
-	for (size_t idx = 0; idx < max_size; ++idx)
+	const unsigned int count = FillFristLine(out);
+	for (auto &index : out)
 	{
-		if (config_.data[idx])
-		{
-			const int row = idx / config_.width;
-			const int base = row * config_.width;
-			for (int col = 0; col < config_.width; ++col)
-			{
-				if (sprites_[base + col] == NOSPRITE)
-				{
-					sprites_[base + col] = Random(1, config_.type_quantity);
-					out.insert(MapIndex(row, col));
-					delegate_->OnRefreshMap(MapIndex(row, col), sprites_[base + col]);
-					++count;
-				}
-			}
-			return count;
-		}
+		delegate_->OnRefreshMap(index, state_.sprites[index.row * config_.width + index.col]);
 	}
 	return count;
 }
 
-// 移动路线
-struct MoveRoute
+// 填充首行空位
+unsigned int Backend::FillFristLine(CellSet &out)
 {
-	MapIndex source;
-	MapIndex target;
+	out.clear();
+	const int base = frist_line_ * config_.width;
+	for (int col = 0; col < config_.width; ++col)
+	{
+		if (state_.sprites[base + col] == NOSPRITE)
+		{
+			out.insert(MapIndex(frist_line_, col));
+		}
+	}
 
-	MoveRoute(const MapIndex &a, const MapIndex &b)
-		: source(a)
-		, target(b)
+	// 一次生成整行所需的随机数
+	const unsigned int count = out.size();
+	if (count > 0)
 	{
+		engine_->Bounded(&random_buffer_[0], count, config_.type_quantity);
+		unsigned int number = 0;
+		for (auto &index : out)
+		{
+			state_.sprites[base + index.col] = 1 + static_cast<int>(random_buffer_[number++]);
+		}
 	}
-};
+	return count;
+}
 
 // 落下精灵
 bool Backend::FalldownSprite()
@@ -369,122 +713,315 @@ bool Backend::FalldownSprite()
 	}
 
 	// 补充第一行精灵
-	std::set<MapIndex> added_set;
+	CellSet added_set;
 	AddSpriteToFristLine(added_set);
 
-	// 获取首行
-	int frist_line = 0;
-	for (int idx = 0; idx < config_.width * config_.height; ++idx)
+	// 精灵下落
+	const bool changed = MoveSprites(added_set);
+
+	// 通知界面播放移动动画
+	int number = 0;
+	const int total = added_set.size() + move_routes_.size();
+	for (auto &index : added_set)
 	{
-		if (config_.data[idx])
+		delegate_->OnSpriteFalldown(index, index, ++number, total);
+	}
+	for (auto &route : move_routes_)
+	{
+		delegate_->OnSpriteFalldown(route.source, route.target, ++number, total);
+	}
+
+	return changed;
+}
+
+// 一次性落下所有精灵
+bool Backend::FalldownAll(FalldownResult &out)
+{
+	if (!initialized_)
+	{
+		throw std::runtime_error("map configuration is not set!");
+	}
+
+	out.tracks.clear();
+	out.waypoints.clear();
+	track_steps_.clear();
+	std::fill(cell_tracks_.begin(), cell_tracks_.end(), -1);
+
+	// 与逐次调用 FalldownSprite 的规则与随机数消耗完全一致，只是不经过界面回调
+	// 某些带洞地图中精灵会来回横移永不稳定，超过轮数上限时放弃
+	bool changed = false;
+	CellSet added_set;
+	out.settled = false;
+	for (int round = 0; round < GetMaxFalldownRounds(); ++round)
+	{
+		FillFristLine(added_set);
+		for (auto &index : added_set)
 		{
-			frist_line = idx / config_.width;
+			const int idx = index.row * config_.width + index.col;
+			FalldownTrack track;
+			track.type = state_.sprites[idx];
+			track.spawned = true;
+			track.first = 0;
+			track.count = 0;
+			cell_tracks_[idx] = out.tracks.size();
+			track_steps_.push_back(TrackStep(cell_tracks_[idx], index));
+			out.tracks.push_back(track);
+		}
+
+		if (!MoveSprites(added_set))
+		{
+			out.settled = true;
 			break;
 		}
+		changed = true;
+
+		for (auto &route : move_routes_)
+		{
+			const int source = route.source.row * config_.width + route.source.col;
+			const int target = route.target.row * config_.width + route.target.col;
+			int track_id = cell_tracks_[source];
+			if (track_id < 0)
+			{
+				FalldownTrack track;
+				track.type = state_.sprites[target];
+				track.spawned = false;
+				track.first = 0;
+				track.count = 0;
+				track_id = out.tracks.size();
+				track_steps_.push_back(TrackStep(track_id, route.source));
+				out.tracks.push_back(track);
+			}
+			cell_tracks_[source] = -1;
+			cell_tracks_[target] = track_id;
+			track_steps_.push_back(TrackStep(track_id, route.target));
+		}
 	}
 
-	// 精灵下落
+	// 按轨迹整理路点，使每条轨迹的路点连续存放
+	for (auto &step : track_steps_)
+	{
+		++out.tracks[step.track].count;
+	}
+	int first = 0;
+	for (auto &track : out.tracks)
+	{
+		track.first = first;
+		first += track.count;
+		track.count = 0;
+	}
+	out.waypoints.resize(first);
+	for (auto &step : track_steps_)
+	{
+		FalldownTrack &track = out.tracks[step.track];
+		out.waypoints[track.first + track.count++] = step.index;
+	}
+
+	return changed;
+}
+
+// 同步执行交换与连锁
+Backend::ResolveResult Backend::ResolveSwap(const MapIndex &a, const MapIndex &b, CascadeLog &log)
+{
+	if (!initialized_)
+	{
+		throw std::runtime_error("map configuration is not set!");
+	}
+
+	log.Clear();
+	if (!IsValidSprite(a) || !IsValidSprite(b) || !IsAdjacent(a, b))
+	{
+		return RESOLVE_INVALID;
+	}
+
+	CellSet eliminate_set;
+	SwapSprite(a, b);
+	if (!IsCanEliminate(b, a, eliminate_set))
+	{
+		SwapSprite(a, b);
+		return RESOLVE_INVALID;
+	}
+
+	// 落下轮数与连锁层数都有上限，防止不会稳定的地图卡死
+	const int max_rounds = GetMaxFalldownRounds();
+	const int max_depth = GetMaxCascadeDepth();
+	int depth = 0;
+	CellSet added_set;
+	do
+	{
+		// 消除
+		for (auto &index : eliminate_set)
+		{
+			const int idx = index.row * config_.width + index.col;
+			log.Push(CascadeEvent::ELIMINATE, depth, idx, state_.sprites[idx]);
+			state_.sprites[idx] = NOSPRITE;
+			state_.souch_scope.update(index);
+		}
+
+		// 落下与补充
+		for (int round = 0;; ++round)
+		{
+			if (round >= max_rounds)
+			{
+				return RESOLVE_UNSTABLE;
+			}
+
+			FillFristLine(added_set);
+			for (auto &index : added_set)
+			{
+				const int idx = index.row * config_.width + index.col;
+				log.Push(CascadeEvent::SPAWN, depth, idx, state_.sprites[idx]);
+			}
+
+			if (!MoveSprites(added_set))
+			{
+				break;
+			}
+
+			for (auto &route : move_routes_)
+			{
+				log.Push(CascadeEvent::MOVE, depth,
+						 route.source.row * config_.width + route.source.col,
+						 route.target.row * config_.width + route.target.col);
+			}
+		}
+		if (++depth >= max_depth)
+		{
+			return RESOLVE_UNSTABLE;
+		}
+	} while (GetMovedSpriteAndCanEliminate(eliminate_set));
+
+	return RESOLVE_OK;
+}
+
+// 连锁层数上限
+int Backend::GetMaxCascadeDepth() const
+{
+	// 类型很少时连锁层数呈长尾分布，8x8 两种类型实测可达两百余层
+	return 64 * config_.width * config_.height;
+}
+
+// 一次落下的轮数上限
+int Backend::GetMaxFalldownRounds() const
+{
+	// 正常情况下每个精灵的路径不超过格子总数，留出一倍余量
+	return 2 * config_.width * config_.height;
+}
+
+// 移动精灵
+bool Backend::MoveSprites(const CellSet &added_set)
+{
+	// 无效格子的值总是 NOTHING，因此用精灵数组代替 config_.data 判断有效格子
+	const int width = config_.width;
+	const int height = config_.height;
+	int8_t *sprites = state_.sprites;
+
 	unsigned int before_size = 0;
-	std::set<MapIndex> moved_set;
-	std::vector<MoveRoute> sp_move_route;
+	CellSet moved_set;
+	move_routes_.clear();
 
 	do
 	{
 		before_size = moved_set.size();
 
 		// 扩大搜索范围
-		if (souch_scope_.min_row > 0) --souch_scope_.min_row;
-		if (souch_scope_.min_col > 0) --souch_scope_.min_col;
-		if (souch_scope_.max_row < config_.height - 1) ++souch_scope_.max_row;
-		if (souch_scope_.max_col < config_.width - 1) ++souch_scope_.max_col;
+		if (state_.souch_scope.min_row > 0) --state_.souch_scope.min_row;
+		if (state_.souch_scope.min_col > 0) --state_.souch_scope.min_col;
+		if (state_.souch_scope.max_row < height - 1) ++state_.souch_scope.max_row;
+		if (state_.souch_scope.max_col < width - 1) ++state_.souch_scope.max_col;
 
-		for (int row = souch_scope_.min_row; row <= souch_scope_.max_row; ++row)
+		for (int row = state_.souch_scope.min_row; row <= state_.souch_scope.max_row; ++row)
 		{
-			for (int col = souch_scope_.min_col; col <= souch_scope_.max_col; ++col)
+			for (int col = state_.souch_scope.min_col; col <= state_.souch_scope.max_col; ++col)
 			{
-				const int current_idx = row * config_.width + col;
-				const int previous_row_idx = (row - 1) * config_.width + col;
-				const int next_row_idx = (row + 1) * config_.width + col;
+				const int current_idx = row * width + col;
+				const int previous_row_idx = (row - 1) * width + col;
+				const int next_row_idx = (row + 1) * width + col;
+
+				// 下方、左侧、右侧都不是空格时精灵不会移动
+				if ((sprites[current_idx] <= NOSPRITE)
+					|| ((row + 1 >= height || sprites[next_row_idx] != NOSPRITE)
+						&& (col - 1 < 0 || sprites[current_idx - 1] != NOSPRITE)
+						&& (col + 1 >= width || sprites[current_idx + 1] != NOSPRITE)))
+				{
+					continue;
+				}
 
 				// 如果此处有精灵并且在此轮中没有被移动过
-				if ((sprites_[current_idx] > NOSPRITE) && (moved_set.find(MapIndex(row, col)) == moved_set.end()))
+				if (moved_set.count(MapIndex(row, col)) == 0)
 				{
 					// 向下补充
-					if ((row + 1 < config_.height)
-						&& (config_.data[next_row_idx])
-						&& (sprites_[next_row_idx] == NOSPRITE))
+					if ((row + 1 < height)
+						&& (sprites[next_row_idx] == NOSPRITE))
 					{
 						moved_set.insert(MapIndex(row + 1, col));
-						std::swap(sprites_[current_idx], sprites_[next_row_idx]);
-						sp_move_route.push_back(MoveRoute(MapIndex(row, col), MapIndex(row + 1, col)));
+						std::swap(sprites[current_idx], sprites[next_row_idx]);
+						move_routes_.push_back(MoveRoute(MapIndex(row, col), MapIndex(row + 1, col)));
 					}
 					// 横向移动
-					else if (row > frist_line)
+					else if (row > frist_line_)
 					{
 						// 如果左边是空格并且空格上方没有精灵
 						if (col - 1 >= 0
-							&& (config_.data[current_idx - 1])
-							&& (!config_.data[previous_row_idx - 1])
-							&& (sprites_[current_idx - 1] == NOSPRITE))
+							&& (sprites[previous_row_idx - 1] == NOTHING)
+							&& (sprites[current_idx - 1] == NOSPRITE))
 						{
 							// 如果空格的左边是有效格
-							if (col - 2 >= 0 && config_.data[current_idx - 2])
+							if (col - 2 >= 0 && sprites[current_idx - 2] != NOTHING)
 							{
 								if (CalculateShortest(MapIndex(row, col)) <= CalculateShortest(MapIndex(row, col - 2)))
 								{
 									moved_set.insert(MapIndex(row, col - 1));
-									std::swap(sprites_[current_idx], sprites_[current_idx - 1]);
-									sp_move_route.push_back(MoveRoute(MapIndex(row, col), MapIndex(row, col - 1)));
+									std::swap(sprites[current_idx], sprites[current_idx - 1]);
+									move_routes_.push_back(MoveRoute(MapIndex(row, col), MapIndex(row, col - 1)));
 									continue;
 								}
-								else if (sprites_[current_idx - 2] > NOSPRITE
+								else if (sprites[current_idx - 2] > NOSPRITE
 										 && moved_set.find(MapIndex(row, col - 2)) == moved_set.end())
 								{
 									moved_set.insert(MapIndex(row, col - 1));
-									std::swap(sprites_[current_idx - 2], sprites_[current_idx - 1]);
-									sp_move_route.push_back(MoveRoute(MapIndex(row, col - 2), MapIndex(row, col - 1)));
+									std::swap(sprites[current_idx - 2], sprites[current_idx - 1]);
+									move_routes_.push_back(MoveRoute(MapIndex(row, col - 2), MapIndex(row, col - 1)));
 									continue;
 								}
 							}
 							else
 							{
 								moved_set.insert(MapIndex(row, col - 1));
-								std::swap(sprites_[current_idx], sprites_[current_idx - 1]);
-								sp_move_route.push_back(MoveRoute(MapIndex(row, col), MapIndex(row, col - 1)));
+								std::swap(sprites[current_idx], sprites[current_idx - 1]);
+								move_routes_.push_back(MoveRoute(MapIndex(row, col), MapIndex(row, col - 1)));
 								continue;
 							}
 						}
 
 						// 如果右边是空格并且空格上方没有精灵
-						if (col + 1 < config_.width
-							&& (config_.data[current_idx + 1])
-							&& (!config_.data[previous_row_idx + 1])
-							&& (sprites_[current_idx + 1] == NOSPRITE))
+						if (col + 1 < width
+							&& (sprites[previous_row_idx + 1] == NOTHING)
+							&& (sprites[current_idx + 1] == NOSPRITE))
 						{
 							// 如果空格的右边是有效格
-							if (col + 2 < config_.width && config_.data[current_idx + 2])
+							if (col + 2 < width && sprites[current_idx + 2] != NOTHING)
 							{
 								if (CalculateShortest(MapIndex(row, col)) <= CalculateShortest(MapIndex(row, col + 2)))
 								{
 									moved_set.insert(MapIndex(row, col + 1));
-									std::swap(sprites_[current_idx], sprites_[current_idx + 1]);
-									sp_move_route.push_back(MoveRoute(MapIndex(row, col), MapIndex(row, col + 1)));
+									std::swap(sprites[current_idx], sprites[current_idx + 1]);
+									move_routes_.push_back(MoveRoute(MapIndex(row, col), MapIndex(row, col + 1)));
 									continue;
 								}
-								else if (sprites_[current_idx + 2] > NOSPRITE
+								else if (sprites[current_idx + 2] > NOSPRITE
 										 && moved_set.find(MapIndex(row, col + 2)) == moved_set.end())
 								{
 									moved_set.insert(MapIndex(row, col + 1));
-									std::swap(sprites_[current_idx + 2], sprites_[current_idx + 1]);
-									sp_move_route.push_back(MoveRoute(MapIndex(row, col + 2), MapIndex(row, col + 1)));
+									std::swap(sprites[current_idx + 2], sprites[current_idx + 1]);
+									move_routes_.push_back(MoveRoute(MapIndex(row, col + 2), MapIndex(row, col + 1)));
 									continue;
 								}
 							}
 							else
 							{
 								moved_set.insert(MapIndex(row, col + 1));
-								std::swap(sprites_[current_idx], sprites_[current_idx + 1]);
-								sp_move_route.push_back(MoveRoute(MapIndex(row, col), MapIndex(row, col + 1)));
+								std::swap(sprites[current_idx], sprites[current_idx + 1]);
+								move_routes_.push_back(MoveRoute(MapIndex(row, col), MapIndex(row, col + 1)));
 								continue;
 							}
 						}
@@ -497,22 +1034,13 @@ bool Backend::FalldownSprite()
 	// 记录下移动过的精灵索引
 	for (auto &index : moved_set)
 	{
-		souch_scope_.update(index);
-		moved_sprites_.insert(index);
+		state_.souch_scope.update(index);
+		state_.moved_sprites.insert(index);
 	}
-
-	// 通知界面播放移动动画
-	int number = 0;
-	const int total = added_set.size() + sp_move_route.size();
 	for (auto &index : added_set)
 	{
-		moved_sprites_.insert(index);
-		delegate_->OnSpriteFalldown(index, index, ++number, total);
-	}
-	for (auto &route : sp_move_route)
-	{
-		delegate_->OnSpriteFalldown(route.source, route.target, ++number, total);
+		state_.moved_sprites.insert(index);
 	}
 
 	return moved_set.empty() ? added_set.empty() == false : true;
-}
\ No newline at end of file
+}
@@ -6,12 +6,14 @@
 
 #pragma once
 
-#include <set>
-#include <random>
 #include <functional>
 
-#include "AStar.h"
+#include "Misc/Random.h"
+#include "Misc/NonCopyable.h"
 #include "Types.h"
+#include "CellSet.h"
+#include "BitBoard.h"
+#include "CascadeLog.h"
 
 class BackendDelegate
 {
@@ -42,6 +44,50 @@ public:
 	virtual void OnSpriteFalldown(const MapIndex &source, const MapIndex &target, unsigned int number, unsigned int total) = 0;
 };
 
+/**
+ * 空代理，用于无界面运行
+ */
+class NullBackendDelegate final : public BackendDelegate
+{
+public:
+	virtual void OnEliminate(const MapIndex &index, unsigned int number, unsigned int total) override {}
+	virtual void OnRefreshMap(const MapIndex &index, int type) override {}
+	virtual void OnSpriteFalldown(const MapIndex &source, const MapIndex &target, unsigned int number, unsigned int total) override {}
+};
+
+/**
+ * 精灵落下轨迹
+ * 路点包含起点，之后每一步移动到的格子依次排列
+ */
+struct FalldownTrack
+{
+	int		type;			// 精灵类型
+	bool	spawned;		// 是否为首行新补充的精灵
+	int		first;			// 首个路点在 FalldownResult::waypoints 中的位置
+	int		count;			// 路点数量
+};
+
+/**
+ * 一次性落下的结果
+ */
+struct FalldownResult
+{
+	std::vector<FalldownTrack>	tracks;
+	std::vector<MapIndex>		waypoints;
+	bool						settled;	// 是否在轮数上限内落满，为 false 时棋盘仍有空位
+
+	FalldownResult()
+		: settled(true)
+	{
+	}
+
+	/* 轨迹的最终位置 */
+	const MapIndex& GetTarget(const FalldownTrack &track) const
+	{
+		return waypoints[track.first + track.count - 1];
+	}
+};
+
 class Backend : public NonCopyable
 {
 public:
@@ -51,6 +97,14 @@ public:
 		NOSPRITE = 0,
 	};
 
+	/* 同步结算的结果 */
+	enum ResolveResult
+	{
+		RESOLVE_INVALID,	// 交换无效，棋盘保持不变
+		RESOLVE_OK,
+		RESOLVE_UNSTABLE,	// 超过轮数上限仍未稳定，棋盘停留在中间状态
+	};
+
 	struct Scope
 	{
 		int min_row;
@@ -72,15 +126,52 @@ public:
 		}
 	};
 
+	/**
+	 * 可变状态，按字节复制即可保存与恢复
+	 * 精灵数组放在末尾，快照只复制地图实际使用的部分
+	 * 类型数量不超过127，每格一个字节
+	 */
+	struct State
+	{
+		Scope			souch_scope;
+		PhiloxState		random;			// 默认随机数发生器的状态，仅在快照时同步
+		CellSet			moved_sprites;
+		int8_t			sprites[MAX_MAP_ROWS * MAX_MAP_COLS];
+	};
+
 public:
 	Backend(BackendDelegate *delegate);
 	~Backend() = default;
 
 public:
+	/**
+	 * 设置随机种子
+	 * 相同的种子与流编号、相同的操作序列总是得到相同的棋盘
+	 * @param seed 种子
+	 * @param stream 流编号，不同棋盘使用不同的流可获得互不相关的序列
+	 */
+	void SetSeed(uint64_t seed, uint64_t stream = 0);
+
+	/**
+	 * 替换随机数发生器
+	 * @param engine 由调用者持有，传入 nullptr 恢复默认的 Philox 发生器
+	 */
+	void SetRandomEngine(RandomEngine *engine);
+
+	/**
+	 * 获取最近一次设置的种子与流编号
+	 */
+	uint64_t GetSeed() const { return seed_; }
+
+	uint64_t GetStream() const { return stream_; }
+
 	/**
 	 * 重新生成地图
+	 * 行优先一次填充，每个格子排除会与左侧或上方两个格子构成三连的类型，并埋设一步可消除的交换
+	 * 类型数量少于3时可能无法避免三连
+	 * @return 是否埋设了可消除的交换，地图形状不允许时返回false
 	 */
-	void ReGeneration();
+	bool ReGeneration();
 
 	/**
 	 * 设置地图
@@ -98,6 +189,42 @@ public:
 	 */
 	int GetMapHeight() const;
 
+	/**
+	 * 计算当前棋盘的哈希值（FNV-1a），用于校验回放
+	 */
+	uint64_t GetBoardHash() const;
+
+	/**
+	 * 导出棋盘，每个格子一个字节，NOTHING 导出为 0xFF
+	 * @param out 至少为 宽 * 高 个字节
+	 */
+	void StoreSprites(uint8_t *out) const;
+
+	/**
+	 * 导入 StoreSprites 导出的棋盘，并清空移动记录
+	 * 只应在棋盘稳定时使用，随机数状态由调用者通过 SetRandomEngine 自行管理
+	 * @param in 至少为 宽 * 高 个字节
+	 */
+	void LoadSprites(const uint8_t *in);
+
+	/**
+	 * 快照所需的字节数，不超过 sizeof(Backend::State)
+	 */
+	size_t GetSnapshotSize() const;
+
+	/**
+	 * 保存可变状态：棋盘、移动记录、搜索范围与默认随机数发生器的状态
+	 * 使用 SetRandomEngine 替换的发生器由调用者自行保存
+	 * @param out 调用者提供的缓冲区，至少为 GetSnapshotSize() 个字节
+	 */
+	void Snapshot(void *out);
+
+	/**
+	 * 恢复 Snapshot 保存的状态，快照必须来自相同的地图
+	 * @param in 快照数据
+	 */
+	void Restore(const void *in);
+
 	/**
 	 * 索引上是否存在有效精灵
 	 * @param 精灵索引
@@ -131,7 +258,37 @@ public:
 	/**
 	 * 获取可以消除的移动过的精灵
 	 */
-	bool GetMovedSpriteAndCanEliminate(std::set<MapIndex> &out);
+	bool GetMovedSpriteAndCanEliminate(CellSet &out);
+
+	/**
+	 * 交换后是否可以消除，不修改棋盘
+	 * @param a 精灵a索引
+	 * @param b 精灵b索引
+	 */
+	bool IsCanSwap(const MapIndex &a, const MapIndex &b);
+
+	/**
+	 * 生成所有可以消除的交换
+	 * 按行优先顺序，每对相邻格子只出现一次（向右或向下）
+	 * @param out 可行的交换
+	 * @return 交换数量
+	 */
+	unsigned int GenerateMoves(std::vector<SwapMove> &out);
+
+	/**
+	 * 是否存在可以消除的交换
+	 */
+	bool HasAnyMove();
+
+	/**
+	 * 获取整个棋盘上所有可消除的精灵
+	 * 使用位棋盘检测，不依赖移动记录
+	 * 位棋盘只是查询时的临时副本，每次调用先按格子从精灵数组重建（O(格子数)），再做移位与运算；
+	 * 交换、消除与落下不维护位棋盘，频繁查询时应优先使用基于移动记录的 GetMovedSpriteAndCanEliminate
+	 * @param out 可消除索引集合
+	 * @return bool
+	 */
+	bool GetAllCanEliminate(CellSet &out);
 
 public:
 	/**
@@ -139,14 +296,14 @@ public:
 	 * @param out 可消除索引集合
 	 * @return bool
 	 */
-	virtual bool IsCanEliminate(const MapIndex &previous, const MapIndex &current, std::set<MapIndex> &out);
+	virtual bool IsCanEliminate(const MapIndex &previous, const MapIndex &current, CellSet &out);
 
 	/**
 	 * 执行消除
 	 * @param in_elements 将被消除的精灵集合
 	 * @reutrn 被消除的精灵数量
 	 */
-	virtual unsigned int DoEliminate(std::set<MapIndex> &in_elements);
+	virtual unsigned int DoEliminate(CellSet &in_elements);
 
 	/**
 	 * 落下精灵
@@ -154,39 +311,145 @@ public:
 	 */
 	virtual bool FalldownSprite();
 
+	/**
+	 * 一次性落下所有精灵直到棋盘补满
+	 * 规则与反复调用 FalldownSprite 相同，但不通知代理，每个精灵的完整路径通过结果返回
+	 * 超过轮数上限仍未落满时停止，out.settled 为 false
+	 * @param out 移动与补充的精灵轨迹
+	 * @reutrn 是否有精灵落下或补充
+	 */
+	bool FalldownAll(FalldownResult &out);
+
+	/**
+	 * 同步执行一次交换及其引起的全部连锁
+	 * 消除、落下、补充循环到棋盘稳定，不通知代理，事件按发生顺序写入 log
+	 * @param a 精灵a索引
+	 * @param b 精灵b索引
+	 * @param log 事件记录，调用前会被清空
+	 * @return 无效交换返回 RESOLVE_INVALID 且棋盘保持不变；落下轮数或连锁层数超过上限时返回 RESOLVE_UNSTABLE
+	 */
+	ResolveResult ResolveSwap(const MapIndex &a, const MapIndex &b, CascadeLog &log);
+
+	/**
+	 * 连锁层数上限，超过时视为棋盘不会稳定
+	 */
+	int GetMaxCascadeDepth() const;
+
 protected:
 	/**
 	 * 添加精灵到首行
 	 * @param 新增精灵的地图索引
 	 * @return 补充数量
 	 */
-	virtual unsigned int AddSpriteToFristLine(std::set<MapIndex> &out);
+	virtual unsigned int AddSpriteToFristLine(CellSet &out);
 
 	/**
 	 * 是否可消除
 	 * @param out 可消除索引集合
 	 * @return bool
 	 */
-	virtual bool IsCanEliminate(const MapIndex &index, std::set<MapIndex> &out);
+	virtual bool IsCanEliminate(const MapIndex &index, CellSet &out);
+
+	/**
+	 * 填充首行空位，不通知代理
+	 * @param out 新增精灵的地图索引
+	 * @return 补充数量
+	 */
+	unsigned int FillFristLine(CellSet &out);
+
+	/**
+	 * 移动精灵一轮，移动路线记录在 move_routes_ 中
+	 * @param added_set 本轮首行新增的精灵
+	 * @return 是否有精灵移动或新增
+	 */
+	bool MoveSprites(const CellSet &added_set);
 
 private:
+	/* 移动路线 */
+	struct MoveRoute
+	{
+		MapIndex source;
+		MapIndex target;
+
+		MoveRoute(const MapIndex &a, const MapIndex &b)
+			: source(a)
+			, target(b)
+		{
+		}
+	};
+
+	/* 轨迹中的一步 */
+	struct TrackStep
+	{
+		int			track;
+		MapIndex	index;
+
+		TrackStep(int track, const MapIndex &index)
+			: track(track)
+			, index(index)
+		{
+		}
+	};
+
 	/**
 	 * 取随机数
 	 */
 	int Random(const int min, const int max);
 
+	/**
+	 * 格子 idx 与 idx - step 类型相同时返回该类型，否则返回 NOSPRITE
+	 */
+	int GetPairType(int idx, int step) const;
+
+	/**
+	 * 在 [1, type_quantity] 中排除 a、b、c 后均匀随机选取类型
+	 * @return 无可选类型时返回 NOSPRITE
+	 */
+	int RandomTypeExcept(int a, int b, int c);
+
+	/**
+	 * 沿一个方向统计同类型精灵数量，最多统计两个
+	 */
+	int CountSameType(int row, int col, int row_step, int col_step, int type) const;
+
+	/**
+	 * 精灵移入格子后是否形成三连
+	 * @param row_step/col_step 交换对象所在的方向，此方向不参与统计
+	 */
+	bool IsFormLine(int row, int col, int row_step, int col_step, int type) const;
+
+	/**
+	 * 计算补充距离场
+	 * 地图有效区域在 SetMap 之后不再变化，只需计算一次
+	 */
+	void BuildRefillDistance();
+
 	/**
 	 * 计算最短距离
+	 * @return 到最近的首行有效格的步数，不可达时返回~0
 	 */
 	int CalculateShortest(const MapIndex &index);
 
+	/**
+	 * 一次落下的轮数上限
+	 */
+	int GetMaxFalldownRounds() const;
+
 private:
-	bool				initialized_;
-	BackendDelegate*	delegate_;
-	MapConfig			config_;
-	Scope				souch_scope_;
-	a_star::AStar		a_star_;
-	std::mt19937		generator_;
-	std::vector<int>	sprites_;
-	std::set<MapIndex>	moved_sprites_;
+	bool					initialized_;
+	BackendDelegate*		delegate_;
+	MapConfig				config_;
+	uint64_t				seed_;
+	uint64_t				stream_;
+	PhiloxEngine			default_engine_;
+	RandomEngine*			engine_;
+	std::vector<uint32_t>	random_buffer_;
+	std::vector<int>		refill_distance_;
+	std::vector<MoveRoute>	move_routes_;
+	int						frist_line_;
+	std::vector<int>		cell_tracks_;
+	std::vector<TrackStep>	track_steps_;
+	BitBoard				bit_board_;
+	BitBoard::Mask			match_mask_;
+	State					state_;
 };
\ No newline at end of file
@@ -0,0 +1,131 @@
+﻿/**
+ * 按类型分层的位棋盘
+ * 每种精灵类型一个位平面，整盘消除检测只需若干次移位与按位与
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Types.h"
+
+class BitBoard
+{
+public:
+	/* 指令集 */
+	enum Isa
+	{
+		ISA_SCALAR,
+		ISA_SSE2,
+		ISA_AVX2,
+	};
+
+	/* 位掩码，位布局与位平面相同 */
+	typedef std::vector<uint64_t> Mask;
+
+public:
+	BitBoard();
+
+public:
+	/**
+	 * 重置棋盘尺寸
+	 * @param height 地图行数
+	 * @param width 地图列数
+	 * @param type_quantity 类型数量
+	 */
+	void Reset(int height, int width, int type_quantity);
+
+	/**
+	 * 清空所有位平面
+	 */
+	void Clear();
+
+	/**
+	 * 从按行存储的精灵数组载入
+	 * @param sprites 精灵类型，小于等于0表示无精灵
+	 */
+	void Load(const int8_t *sprites);
+
+	/**
+	 * 设置格子类型
+	 * @param type 小于等于0表示清空
+	 */
+	void Set(const MapIndex &index, int type);
+
+	/**
+	 * 获取格子类型
+	 * @return 无精灵时返回0
+	 */
+	int Get(const MapIndex &index) const;
+
+	/**
+	 * 计算所有处于三连及以上的格子
+	 * @param out 结果掩码
+	 * @return 是否存在可消除格子
+	 */
+	bool GetMatches(Mask &out);
+
+	/**
+	 * 掩码中是否包含格子
+	 */
+	bool Test(const Mask &mask, const MapIndex &index) const;
+
+	/**
+	 * 按行优先顺序遍历掩码中的格子
+	 */
+	template <typename Function>
+	void Visit(const Mask &mask, Function func) const
+	{
+		for (int word = 0; word < words_; ++word)
+		{
+			uint64_t bits = mask[word];
+			while (bits)
+			{
+				const int bit = word * 64 + CountTrailingZeros(bits);
+				func(MapIndex(bit / stride_, bit % stride_));
+				bits &= bits - 1;
+			}
+		}
+	}
+
+	int GetWidth() const { return width_; }
+
+	int GetHeight() const { return height_; }
+
+public:
+	/**
+	 * 当前使用的指令集
+	 */
+	static Isa GetIsa();
+
+	/**
+	 * 强制使用指定指令集，用于测试与性能对比
+	 * @return CPU或编译器不支持时返回false
+	 */
+	static bool ForceIsa(Isa isa);
+
+	/**
+	 * 指令集名称
+	 */
+	static const char* GetIsaName(Isa isa);
+
+private:
+	static int CountTrailingZeros(uint64_t bits);
+
+	uint64_t* Plane(int word) { return &planes_[(pad_ + word) * lanes_]; }
+
+	const uint64_t* Plane(int word) const { return &planes_[(pad_ + word) * lanes_]; }
+
+private:
+	int						height_;
+	int						width_;
+	int						stride_;		// 每行位数，比列数多一位作为行间隔
+	int						types_;
+	int						lanes_;			// 类型数量向上对齐到向量宽度
+	int						words_;			// 每个位平面的64位字数量
+	int						pad_;			// 前后填充的零字数量，避免移位越界检查
+	std::vector<uint64_t>	planes_;		// 按 [字][类型] 交错存储
+	std::vector<uint64_t>	scratch_;
+	std::vector<uint64_t>	accum_;
+};
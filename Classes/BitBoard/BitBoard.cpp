@@ -0,0 +1,318 @@
+﻿#include "BitBoard.h"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include "MatchKernel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BIT_BOARD_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace bit_board
+{
+	/************************************************************************/
+
+	struct ScalarOps
+	{
+		typedef uint64_t Vec;
+		static const int kLanes = 1;
+
+		static Vec Load(const uint64_t *p) { return *p; }
+		static void Store(uint64_t *p, Vec v) { *p = v; }
+		static Vec And(Vec a, Vec b) { return a & b; }
+		static Vec Or(Vec a, Vec b) { return a | b; }
+		static Vec Shl(Vec v, int r) { return v << r; }
+		static Vec Shr(Vec v, int r) { return v >> r; }
+	};
+
+	void MatchKernelScalar(const KernelArgs &args)
+	{
+		MatchKernel<ScalarOps>(args);
+	}
+
+#ifdef BIT_BOARD_SSE2
+	struct Sse2Ops
+	{
+		typedef __m128i Vec;
+		static const int kLanes = 2;
+
+		static Vec Load(const uint64_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+		static void Store(uint64_t *p, Vec v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+		static Vec And(Vec a, Vec b) { return _mm_and_si128(a, b); }
+		static Vec Or(Vec a, Vec b) { return _mm_or_si128(a, b); }
+		static Vec Shl(Vec v, int r) { return _mm_sll_epi64(v, _mm_cvtsi32_si128(r)); }
+		static Vec Shr(Vec v, int r) { return _mm_srl_epi64(v, _mm_cvtsi32_si128(r)); }
+	};
+
+	void MatchKernelSse2(const KernelArgs &args)
+	{
+		MatchKernel<Sse2Ops>(args);
+	}
+#endif
+
+	/************************************************************************/
+
+	bool CpuSupports(BitBoard::Isa isa)
+	{
+		switch (isa)
+		{
+		case BitBoard::ISA_SCALAR:
+			return true;
+
+		case BitBoard::ISA_SSE2:
+#ifdef BIT_BOARD_SSE2
+			return true;
+#else
+			return false;
+#endif
+
+		case BitBoard::ISA_AVX2:
+#if defined(BIT_BOARD_AVX2) && (defined(__GNUC__) || defined(__clang__))
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") != 0;
+#elif defined(BIT_BOARD_AVX2) && defined(_MSC_VER)
+			{
+				int info[4];
+				__cpuid(info, 0);
+				if (info[0] < 7) return false;
+				__cpuid(info, 1);
+				const bool osxsave = (info[2] & (1 << 27)) != 0;
+				const bool avx = (info[2] & (1 << 28)) != 0;
+				if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+				__cpuidex(info, 7, 0);
+				return (info[1] & (1 << 5)) != 0;
+			}
+#else
+			return false;
+#endif
+		}
+		return false;
+	}
+
+	MatchKernelFunc GetKernel(BitBoard::Isa isa)
+	{
+		switch (isa)
+		{
+#ifdef BIT_BOARD_AVX2
+		case BitBoard::ISA_AVX2:
+			return MatchKernelAvx2;
+#endif
+#ifdef BIT_BOARD_SSE2
+		case BitBoard::ISA_SSE2:
+			return MatchKernelSse2;
+#endif
+		default:
+			return MatchKernelScalar;
+		}
+	}
+
+	BitBoard::Isa DetectIsa()
+	{
+		if (CpuSupports(BitBoard::ISA_AVX2)) return BitBoard::ISA_AVX2;
+		if (CpuSupports(BitBoard::ISA_SSE2)) return BitBoard::ISA_SSE2;
+		return BitBoard::ISA_SCALAR;
+	}
+
+	/* 进程内只检测一次，可被 ForceIsa 覆盖 */
+	BitBoard::Isa& CurrentIsa()
+	{
+		static BitBoard::Isa isa = DetectIsa();
+		return isa;
+	}
+}
+
+/************************************************************************/
+
+// 向量宽度，类型数量按此对齐
+static const int kMaxLanes = 4;
+
+BitBoard::BitBoard()
+	: height_(0)
+	, width_(0)
+	, stride_(0)
+	, types_(0)
+	, lanes_(0)
+	, words_(0)
+	, pad_(0)
+{
+}
+
+// 重置棋盘尺寸
+void BitBoard::Reset(int height, int width, int type_quantity)
+{
+	if (height <= 0 || width <= 0 || type_quantity <= 0)
+	{
+		throw std::runtime_error("invalid bit board size!");
+	}
+
+	height_ = height;
+	width_ = width;
+	stride_ = width + 1;
+	types_ = type_quantity;
+	lanes_ = (type_quantity + kMaxLanes - 1) / kMaxLanes * kMaxLanes;
+	words_ = (stride_ * height_ + 63) / 64;
+	pad_ = (stride_ * 2) / 64 + 1;
+
+	const size_t size = (words_ + pad_ * 2) * lanes_;
+	planes_.assign(size, 0);
+	scratch_.assign(size, 0);
+	accum_.assign(size, 0);
+}
+
+// 清空所有位平面
+void BitBoard::Clear()
+{
+	std::fill(planes_.begin(), planes_.end(), 0);
+}
+
+// 从精灵数组载入
+void BitBoard::Load(const int8_t *sprites)
+{
+	Clear();
+	for (int row = 0; row < height_; ++row)
+	{
+		for (int col = 0; col < width_; ++col)
+		{
+			const int type = sprites[row * width_ + col];
+			if (type > 0 && type <= types_)
+			{
+				const int bit = row * stride_ + col;
+				Plane(bit >> 6)[type - 1] |= uint64_t(1) << (bit & 63);
+			}
+		}
+	}
+}
+
+// 设置格子类型
+void BitBoard::Set(const MapIndex &index, int type)
+{
+	assert(index.row >= 0 && index.row < height_ && index.col >= 0 && index.col < width_);
+
+	const int bit = index.row * stride_ + index.col;
+	const uint64_t mask = uint64_t(1) << (bit & 63);
+	uint64_t *plane = Plane(bit >> 6);
+	for (int lane = 0; lane < types_; ++lane)
+	{
+		plane[lane] &= ~mask;
+	}
+	if (type > 0 && type <= types_)
+	{
+		plane[type - 1] |= mask;
+	}
+}
+
+// 获取格子类型
+int BitBoard::Get(const MapIndex &index) const
+{
+	assert(index.row >= 0 && index.row < height_ && index.col >= 0 && index.col < width_);
+
+	const int bit = index.row * stride_ + index.col;
+	const uint64_t mask = uint64_t(1) << (bit & 63);
+	const uint64_t *plane = Plane(bit >> 6);
+	for (int lane = 0; lane < types_; ++lane)
+	{
+		if (plane[lane] & mask) return lane + 1;
+	}
+	return 0;
+}
+
+// 计算所有处于三连及以上的格子
+bool BitBoard::GetMatches(Mask &out)
+{
+	out.assign(words_, 0);
+	if (words_ == 0)
+	{
+		return false;
+	}
+
+	std::fill(accum_.begin(), accum_.end(), 0);
+
+	bit_board::KernelArgs args;
+	args.planes = Plane(0);
+	args.scratch = &scratch_[pad_ * lanes_];
+	args.accum = &accum_[pad_ * lanes_];
+	args.words = words_;
+	args.lanes = lanes_;
+	args.stride = stride_;
+	bit_board::GetKernel(bit_board::CurrentIsa())(args);
+
+	uint64_t any = 0;
+	for (int word = 0; word < words_; ++word)
+	{
+		const uint64_t *accum = args.accum + word * lanes_;
+		uint64_t bits = 0;
+		for (int lane = 0; lane < types_; ++lane)
+		{
+			bits |= accum[lane];
+		}
+		out[word] = bits;
+		any |= bits;
+	}
+	return any != 0;
+}
+
+// 掩码中是否包含格子
+bool BitBoard::Test(const Mask &mask, const MapIndex &index) const
+{
+	if (index.row < 0 || index.row >= height_ || index.col < 0 || index.col >= width_)
+	{
+		return false;
+	}
+	const int bit = index.row * stride_ + index.col;
+	return (mask[bit >> 6] >> (bit & 63)) & 1;
+}
+
+int BitBoard::CountTrailingZeros(uint64_t bits)
+{
+	assert(bits != 0);
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(bits);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return static_cast<int>(index);
+#else
+	int count = 0;
+	while ((bits & 1) == 0)
+	{
+		bits >>= 1;
+		++count;
+	}
+	return count;
+#endif
+}
+
+BitBoard::Isa BitBoard::GetIsa()
+{
+	return bit_board::CurrentIsa();
+}
+
+bool BitBoard::ForceIsa(Isa isa)
+{
+	if (!bit_board::CpuSupports(isa))
+	{
+		return false;
+	}
+	bit_board::CurrentIsa() = isa;
+	return true;
+}
+
+const char* BitBoard::GetIsaName(Isa isa)
+{
+	switch (isa)
+	{
+	case ISA_SSE2:
+		return "sse2";
+	case ISA_AVX2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
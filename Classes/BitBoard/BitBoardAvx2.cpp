@@ -0,0 +1,32 @@
+﻿/**
+ * AVX2 内核，此文件单独以 AVX2 指令集编译，运行时检测到 CPU 支持才会调用
+ */
+
+#include "MatchKernel.h"
+
+#ifdef BIT_BOARD_AVX2
+
+#include <immintrin.h>
+
+namespace bit_board
+{
+	struct Avx2Ops
+	{
+		typedef __m256i Vec;
+		static const int kLanes = 4;
+
+		static Vec Load(const uint64_t *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+		static void Store(uint64_t *p, Vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); }
+		static Vec And(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+		static Vec Or(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+		static Vec Shl(Vec v, int r) { return _mm256_sll_epi64(v, _mm_cvtsi32_si128(r)); }
+		static Vec Shr(Vec v, int r) { return _mm256_srl_epi64(v, _mm_cvtsi32_si128(r)); }
+	};
+
+	void MatchKernelAvx2(const KernelArgs &args)
+	{
+		MatchKernel<Avx2Ops>(args);
+	}
+}
+
+#endif
@@ -0,0 +1,97 @@
+﻿/**
+ * 位棋盘消除检测内核
+ * 同一份模板按标量 / SSE2 / AVX2 实例化，向量化方向为精灵类型
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace bit_board
+{
+	/**
+	 * 内核参数
+	 * planes / scratch / accum 指向第0个字，前后各有若干零字填充，每个字占 lanes 个 uint64_t
+	 */
+	struct KernelArgs
+	{
+		const uint64_t*	planes;
+		uint64_t*		scratch;
+		uint64_t*		accum;
+		int				words;
+		int				lanes;
+		int				stride;
+	};
+
+	typedef void(*MatchKernelFunc)(const KernelArgs &args);
+
+	void MatchKernelScalar(const KernelArgs &args);
+
+	void MatchKernelSse2(const KernelArgs &args);
+
+	void MatchKernelAvx2(const KernelArgs &args);
+
+	/* 结果第 i 位为输入第 i + k 位 */
+	template <typename Ops>
+	inline typename Ops::Vec ShiftDown(const uint64_t *p, int word, int lanes, int q, int r)
+	{
+		typename Ops::Vec lo = Ops::Load(p + (word + q) * lanes);
+		if (r == 0) return lo;
+		typename Ops::Vec hi = Ops::Load(p + (word + q + 1) * lanes);
+		return Ops::Or(Ops::Shr(lo, r), Ops::Shl(hi, 64 - r));
+	}
+
+	/* 结果第 i 位为输入第 i - k 位 */
+	template <typename Ops>
+	inline typename Ops::Vec ShiftUp(const uint64_t *p, int word, int lanes, int q, int r)
+	{
+		typename Ops::Vec lo = Ops::Load(p + (word - q) * lanes);
+		if (r == 0) return lo;
+		typename Ops::Vec prev = Ops::Load(p + (word - q - 1) * lanes);
+		return Ops::Or(Ops::Shl(lo, r), Ops::Shr(prev, 64 - r));
+	}
+
+	/**
+	 * 沿一个方向检测三连
+	 * step 为1时检测横向，为行宽时检测纵向
+	 */
+	template <typename Ops>
+	inline void RunKernel(const KernelArgs &args, int step)
+	{
+		const int lanes = args.lanes;
+		const int q1 = step >> 6, r1 = step & 63;
+		const int q2 = (step * 2) >> 6, r2 = (step * 2) & 63;
+
+		for (int lane = 0; lane < lanes; lane += Ops::kLanes)
+		{
+			const uint64_t *planes = args.planes + lane;
+			uint64_t *scratch = args.scratch + lane;
+			uint64_t *accum = args.accum + lane;
+
+			// 三连起点: P & (P >> k) & (P >> 2k)
+			for (int word = 0; word < args.words; ++word)
+			{
+				typename Ops::Vec start = Ops::And(Ops::Load(planes + word * lanes),
+												   Ops::And(ShiftDown<Ops>(planes, word, lanes, q1, r1),
+															ShiftDown<Ops>(planes, word, lanes, q2, r2)));
+				Ops::Store(scratch + word * lanes, start);
+			}
+
+			// 起点向后展开两格: S | (S << k) | (S << 2k)
+			for (int word = 0; word < args.words; ++word)
+			{
+				typename Ops::Vec cells = Ops::Or(Ops::Load(scratch + word * lanes),
+												  Ops::Or(ShiftUp<Ops>(scratch, word, lanes, q1, r1),
+														  ShiftUp<Ops>(scratch, word, lanes, q2, r2)));
+				Ops::Store(accum + word * lanes, Ops::Or(Ops::Load(accum + word * lanes), cells));
+			}
+		}
+	}
+
+	template <typename Ops>
+	inline void MatchKernel(const KernelArgs &args)
+	{
+		RunKernel<Ops>(args, 1);
+		RunKernel<Ops>(args, args.stride);
+	}
+}
@@ -0,0 +1,82 @@
+﻿/**
+ * 连锁消除事件记录
+ * 扁平的预分配缓冲区，供界面之后按顺序回放
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+/* 连锁事件 */
+struct CascadeEvent
+{
+	enum Type
+	{
+		ELIMINATE,		// 消除: source 为格子，value 为被消除的类型
+		SPAWN,			// 补充: source 为格子，value 为新精灵类型
+		MOVE,			// 移动: source 为起点，value 为终点格子
+	};
+
+	uint8_t		type;
+	uint8_t		depth;			// 连锁层数，交换直接引起的消除为0
+	uint16_t	source;			// 格子索引 row * width + col
+	uint16_t	value;
+};
+
+class CascadeLog
+{
+public:
+	/**
+	 * @param capacity 预分配的事件数量
+	 */
+	explicit CascadeLog(size_t capacity = 1024)
+		: max_depth_(0)
+		, eliminated_(0)
+	{
+		events_.reserve(capacity);
+	}
+
+public:
+	/**
+	 * 清空记录，保留已分配的内存
+	 */
+	void Clear()
+	{
+		events_.clear();
+		max_depth_ = 0;
+		eliminated_ = 0;
+	}
+
+	void Push(CascadeEvent::Type type, int depth, int source, int value)
+	{
+		CascadeEvent event;
+		event.type = static_cast<uint8_t>(type);
+		event.depth = static_cast<uint8_t>(depth < 255 ? depth : 255);
+		event.source = static_cast<uint16_t>(source);
+		event.value = static_cast<uint16_t>(value);
+		events_.push_back(event);
+
+		if (depth > max_depth_) max_depth_ = depth;
+		if (type == CascadeEvent::ELIMINATE) ++eliminated_;
+	}
+
+	size_t Size() const { return events_.size(); }
+
+	bool Empty() const { return events_.empty(); }
+
+	const CascadeEvent& operator[] (size_t index) const { return events_[index]; }
+
+	const CascadeEvent* Data() const { return events_.empty() ? nullptr : &events_[0]; }
+
+	/* 最大连锁层数 */
+	int GetMaxDepth() const { return max_depth_; }
+
+	/* 消除的精灵总数 */
+	unsigned int GetEliminated() const { return eliminated_; }
+
+private:
+	std::vector<CascadeEvent>	events_;
+	int							max_depth_;
+	unsigned int				eliminated_;
+};
@@ -0,0 +1,196 @@
+﻿/**
+ * 固定容量的格子集合
+ * 每行一个64位字，插入、查找、删除均为O(1)，遍历按行优先顺序进行，全程不分配堆内存
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "Types.h"
+
+class CellSet
+{
+	static_assert(MAX_MAP_COLS <= 64, "one row must fit in a 64-bit word");
+
+public:
+	class const_iterator
+	{
+	public:
+		const_iterator() : owner_(nullptr), bits_(0) {}
+
+		const_iterator(const CellSet *owner, int row)
+			: owner_(owner)
+			, bits_(0)
+		{
+			index_.row = row;
+			Seek();
+		}
+
+		const MapIndex& operator* () const { return index_; }
+
+		const MapIndex* operator-> () const { return &index_; }
+
+		const_iterator& operator++ ()
+		{
+			bits_ &= bits_ - 1;
+			if (bits_)
+			{
+				index_.col = CountTrailingZeros(bits_);
+			}
+			else
+			{
+				++index_.row;
+				Seek();
+			}
+			return *this;
+		}
+
+		bool operator== (const const_iterator &that) const
+		{
+			return index_ == that.index_;
+		}
+
+		bool operator!= (const const_iterator &that) const
+		{
+			return index_ != that.index_;
+		}
+
+	private:
+		friend class CellSet;
+
+		// 定位到当前行或之后的第一个元素
+		void Seek()
+		{
+			while (index_.row < owner_->rows_)
+			{
+				bits_ = owner_->bits_[index_.row];
+				if (bits_)
+				{
+					index_.col = CountTrailingZeros(bits_);
+					return;
+				}
+				++index_.row;
+			}
+			bits_ = 0;
+			index_ = MapIndex();
+		}
+
+	private:
+		const CellSet*	owner_;
+		uint64_t		bits_;
+		MapIndex		index_;
+	};
+
+	typedef const_iterator iterator;
+
+public:
+	CellSet()
+		: rows_(0)
+		, size_(0)
+	{
+		memset(bits_, 0, sizeof(bits_));
+	}
+
+public:
+	/**
+	 * 插入格子
+	 * @return 是否为新插入
+	 */
+	bool insert(const MapIndex &index)
+	{
+		assert(IsInRange(index));
+		const uint64_t mask = uint64_t(1) << index.col;
+		uint64_t &word = bits_[index.row];
+		if (word & mask)
+		{
+			return false;
+		}
+		word |= mask;
+		++size_;
+		if (index.row >= rows_) rows_ = index.row + 1;
+		return true;
+	}
+
+	/**
+	 * 删除格子
+	 * @return 删除数量
+	 */
+	size_t erase(const MapIndex &index)
+	{
+		if (!count(index))
+		{
+			return 0;
+		}
+		bits_[index.row] &= ~(uint64_t(1) << index.col);
+		--size_;
+		return 1;
+	}
+
+	/**
+	 * 是否包含格子
+	 */
+	size_t count(const MapIndex &index) const
+	{
+		return IsInRange(index) && index.row < rows_ ? (bits_[index.row] >> index.col) & 1 : 0;
+	}
+
+	const_iterator find(const MapIndex &index) const
+	{
+		if (!count(index))
+		{
+			return end();
+		}
+		const_iterator itr;
+		itr.owner_ = this;
+		itr.index_ = index;
+		itr.bits_ = bits_[index.row] & (~uint64_t(0) << index.col);
+		return itr;
+	}
+
+	/**
+	 * 清空集合，只清理使用过的行
+	 */
+	void clear()
+	{
+		memset(bits_, 0, sizeof(uint64_t) * rows_);
+		rows_ = 0;
+		size_ = 0;
+	}
+
+	size_t size() const { return size_; }
+
+	bool empty() const { return size_ == 0; }
+
+	const_iterator begin() const { return const_iterator(this, 0); }
+
+	const_iterator end() const { return const_iterator(this, rows_); }
+
+private:
+	static bool IsInRange(const MapIndex &index)
+	{
+		return index.row >= 0 && index.row < MAX_MAP_ROWS && index.col >= 0 && index.col < MAX_MAP_COLS;
+	}
+
+	static int CountTrailingZeros(uint64_t bits)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_ctzll(bits);
+#else
+		int count = 0;
+		while ((bits & 1) == 0)
+		{
+			bits >>= 1;
+			++count;
+		}
+		return count;
+#endif
+	}
+
+private:
+	int			rows_;						// 使用过的行数
+	int			size_;
+	uint64_t	bits_[MAX_MAP_ROWS];
+};
@@ -2,6 +2,7 @@
 #include "cocos2d.h"
 #include "json/document.h"
 #include "2d/CCTMXXMLParser.h"
+#include "Level.h"
 using namespace cocos2d;
 
 
@@ -11,6 +12,7 @@ Config::Config()
 	, element_width_(0)
 	, element_height_(0)
 	, type_quantity_(0)
+	, level_pack_failed_(false)
 {
 	ReadConfigFile();
 }
@@ -22,6 +24,27 @@ Config::~Config()
 /* ȡļ */
 void Config::ReadConfigFile()
 {
+	// 汾ʹùʱ config.json ɵĶã԰汾Ƕȡ config.json
+	Data binary;
+#if COCOS2D_DEBUG == 0
+	if (FileUtils::getInstance()->isFileExist("config/config.bin"))
+	{
+		binary = FileUtils::getInstance()->getDataFromFile("config/config.bin");
+	}
+#endif
+
+	GameConfigRecord record;
+	if (DecodeGameConfig(binary.getBytes(), binary.getSize(), record))
+	{
+		element_width_ = record.element_width;
+		element_height_ = record.element_height;
+		type_quantity_ = record.type_quantity;
+		move_time_ = record.move_time;
+		fall_down_time_ = record.fall_down_time;
+		cocos2d::log("config loaded from config/config.bin");
+		return;
+	}
+
 	Data data = FileUtils::getInstance()->getDataFromFile("config/config.json");
 	CCAssert(!data.isNull(), "The config/config.json file does not exist");
 
@@ -35,19 +58,46 @@ void Config::ReadConfigFile()
 	type_quantity_ = doc["TypeQuantity"].GetInt();
 	move_time_ = doc["MoveTime"].GetDouble();
 	fall_down_time_ = doc["FallDownTime"].GetDouble();
+	cocos2d::log("config loaded from config/config.json");
 }
 
 /* ȡͼļ */
-MapConfig Config::ReadMapConfig(const std::string &filename)
+bool Config::ReadMapConfig(const std::string &filename, MapConfig &config)
 {
-	MapConfig config;
+	config.width = 0;
+	config.height = 0;
+	config.type_quantity = 0;
+	config.data.clear();
+
+	// ƹؿֻļͷ밴λ洢ЧֱӶȡ
+	if (filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".lvl") == 0)
+	{
+		Data data = FileUtils::getInstance()->getDataFromFile(filename);
+		LevelView view;
+		if (!view.Open(data.getBytes(), data.getSize()))
+		{
+			cocos2d::log("invalid level file: %s", filename.c_str());
+			return false;
+		}
+		view.ToMapConfig(config);
+
+		if (config.type_quantity > type_quantity_)
+		{
+			config.type_quantity = type_quantity_;
+		}
+		return true;
+	}
 
 	Size map_size;
 	auto map_info = TMXMapInfo::create(filename);
+	if (map_info == nullptr || map_info->getLayers().empty())
+	{
+		cocos2d::log("invalid map file: %s", filename.c_str());
+		return false;
+	}
 	map_info->setTileSize(map_size);
 
 	auto layers = map_info->getLayers();
-	CCAssert(!layers.empty(), "");
 
 	auto tiles = layers.front()->_tiles;
 	auto layer_ize = layers.front()->_layerSize;
@@ -67,5 +117,84 @@ MapConfig Config::ReadMapConfig(const std::string &filename)
 		config.data.push_back(tiles[idx] != 0);
 	}
 
-	return config;
+	return true;
+}
+
+/* 򿪹ؿ */
+bool Config::OpenLevelPack()
+{
+	const std::string filename = "map/levels.pack";
+	if (!FileUtils::getInstance()->isFileExist(filename))
+	{
+		cocos2d::log("level pack %s does not exist", filename.c_str());
+		return false;
+	}
+
+#if CC_TARGET_PLATFORM == CC_PLATFORM_ANDROID
+	// װڵļ޷ӳ䣬ȡڴ
+	Data data = FileUtils::getInstance()->getDataFromFile(filename);
+	level_pack_data_.assign(data.getBytes(), data.getBytes() + data.getSize());
+	if (!level_pack_.Open(level_pack_data_.empty() ? nullptr : &level_pack_data_[0], level_pack_data_.size()))
+	{
+		cocos2d::log("invalid level pack: %s", filename.c_str());
+		level_pack_data_.clear();
+		return false;
+	}
+#else
+	// ӳʧʱ LevelPack ׳쳣תΪֵ
+	try
+	{
+		level_pack_.Open(FileUtils::getInstance()->fullPathForFilename(filename));
+	}
+	catch (const std::exception &e)
+	{
+		cocos2d::log("%s", e.what());
+		return false;
+	}
+#endif
+	return true;
+}
+
+/* ȡؿ */
+size_t Config::GetLevelCount()
+{
+	// ʧܺԣÿβѯļ
+	if (!level_pack_.IsOpen() && !level_pack_failed_)
+	{
+		level_pack_failed_ = !OpenLevelPack();
+	}
+	return level_pack_.IsOpen() ? level_pack_.GetLevelCount() : 0;
+}
+
+/* ȡؿеĹؿ */
+bool Config::ReadLevel(size_t index, MapConfig &config)
+{
+	config.width = 0;
+	config.height = 0;
+	config.type_quantity = 0;
+	config.data.clear();
+
+	if (index >= GetLevelCount())
+	{
+		return false;
+	}
+
+	try
+	{
+		config = *level_pack_.GetLevel(index);
+	}
+	catch (const std::exception &e)
+	{
+		cocos2d::log("%s", e.what());
+		return false;
+	}
+
+	if (config.type_quantity > type_quantity_)
+	{
+		config.type_quantity = type_quantity_;
+	}
+
+	// 浱ǰؿʱں̨һ
+	level_pack_.Prefetch(index + 1);
+	return true;
 }
\ No newline at end of file
@@ -6,7 +6,11 @@
 
 #pragma once
 
+#include <vector>
+#include <cstdint>
+
 #include "Types.h"
+#include "LevelPack.h"
 #include "Misc/Singleton.h"
 
 class Config final : public Singleton < Config >
@@ -44,17 +48,35 @@ public:
 		return move_time_;
 	}
 
-	/* 读取地图配置文件 */
-	MapConfig ReadMapConfig(const std::string &filename);
+	/**
+	 * 读取地图配置文件，支持 .tmx 与 eliminate_levelconv 生成的 .lvl
+	 * @return 文件不存在或无效时返回 false，config 为空地图
+	 */
+	bool ReadMapConfig(const std::string &filename, MapConfig &config);
+
+	/**
+	 * 读取关卡包 map/levels.pack 中的关卡，并在后台预取下一关
+	 * @return 关卡包不存在、无效、序号越界或关卡损坏时返回 false，config 为空地图
+	 */
+	bool ReadLevel(size_t index, MapConfig &config);
+
+	/* 获取关卡数量，关卡包打开失败时为0且不再重试 */
+	size_t GetLevelCount();
 
 private:
 	/* 读取配置文件 */
 	void ReadConfigFile();
 
+	/* 打开关卡包，只读取索引 */
+	bool OpenLevelPack();
+
 private:
 	float move_time_;
 	float fall_down_time_;
 	int element_width_;
 	int element_height_;
 	int type_quantity_;
+	LevelPack level_pack_;
+	bool level_pack_failed_;				// 关卡包打开失败，不再重试
+	std::vector<uint8_t> level_pack_data_;	// 无法映射文件时读取的关卡包
 };
\ No newline at end of file
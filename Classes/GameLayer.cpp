@@ -9,6 +9,8 @@ using namespace cocos2d;
 GameLayer::GameLayer()
 	: touch_lock_(false)
 	, backend_(this)
+	, eliminated_(0)
+	, map_count_(0)
 {
 
 }
@@ -103,16 +105,17 @@ void GameLayer::OnChangeFinished()
 	// 落下精灵(返回false说明棋盘已经补满)
 	if (!backend_.FalldownSprite())
 	{
-		std::set<MapIndex> eliminate_set;
+		CellSet eliminate_set;
 		if (!backend_.GetMovedSpriteAndCanEliminate(eliminate_set))
 		{
+			replay_.Finish(backend_.GetBoardHash(), eliminated_);
 			touch_lock_ = false;
 			previous_selected_.col = INVALID_INDEX;
 			previous_selected_.row = INVALID_INDEX;
 		}
 		else
 		{
-			backend_.DoEliminate(eliminate_set);		
+			eliminated_ += backend_.DoEliminate(eliminate_set);
 		}
 	}
 }
@@ -227,6 +230,11 @@ void GameLayer::SetMap(const MapConfig &map_config)
 {
 	InitFloor();
 	InitElements();
+	eliminated_ = 0;
+
+	// 每张地图从新的随机流开始，回放记录的种子与流编号即为生成棋盘时的状态
+	backend_.SetSeed(backend_.GetSeed(), map_count_++);
+	replay_.Begin(map_config, backend_.GetSeed(), backend_.GetStream());
 	backend_.SetMap(map_config);
 }
 
@@ -247,7 +255,7 @@ void GameLayer::SwapElementPositionFinished()
 	}
 
 	// 如果类型相同
-	std::set<MapIndex> eliminate_set;
+	CellSet eliminate_set;
 	if (!backend_.IsCanEliminate(current_selected_, previous_selected_, eliminate_set))
 	{
 		reset = true;
@@ -256,7 +264,8 @@ void GameLayer::SwapElementPositionFinished()
 	else
 	{
 		// 执行消除
-		backend_.DoEliminate(eliminate_set);
+		replay_.AddMove(previous_selected_, current_selected_);
+		eliminated_ += backend_.DoEliminate(eliminate_set);
 	}
 }
 
@@ -8,6 +8,8 @@
 
 #include <map>
 #include "Backend.h"
+#include "Replay.h"
+#include "Misc/PoolAllocator.h"
 #include "cocos2d.h"
 
 class GameLayer final : public cocos2d::Layer, public BackendDelegate
@@ -32,6 +34,11 @@ public:
 	 */
 	void SetMap(const MapConfig &map_config);
 
+	/**
+	 * 获取本局的回放记录，棋盘稳定时文件头已写入结束状态
+	 */
+	const ReplayWriter& GetReplay() const { return replay_; }
+
 private:
 	/**
 	 * 获取起点坐标
@@ -83,16 +90,21 @@ private:
 	void SwapElementPositionFinished();
 	
 private:
-	/* a*算法 */
-	a_star::AStar							a_star_;
 	/* 触摸锁 */
 	bool									touch_lock_;
 	/* 核心算法 */
 	Backend									backend_;
+	/* 回放记录 */
+	ReplayWriter							replay_;
+	/* 消除的精灵总数 */
+	unsigned int							eliminated_;
+	/* 已设置的地图数量，作为每张地图的随机流编号 */
+	uint64_t								map_count_;
 	/* 地板元素 */
 	std::vector<cocos2d::Sprite*>			floor_elments;
-	/* 使用的元素 */
-	std::map<MapIndex, cocos2d::Sprite*>	used_elments;
+	/* 使用的元素，树节点从 SOA 分配 */
+	std::map<MapIndex, cocos2d::Sprite*, std::less<MapIndex>,
+		PoolAllocator<std::pair<const MapIndex, cocos2d::Sprite*>>>	used_elments;
 	/* 闲置的元素 */
 	std::vector<cocos2d::Sprite *>			free_elements;
 	/* 批量渲染 */
@@ -32,9 +32,17 @@ bool GameScene::init()
 	background_->setPosition(Vec2(VisibleRect::center().x, VisibleRect::bottom().y + background_->getContentSize().height / 2));
 	addChild(background_);
 
+	// 关卡包由构建生成，没有关卡包（例如 VS 工程不运行转换工具）或读取失败时读取 map.tmx
+	auto config = Config::GetInstance();
+	MapConfig map_config;
+	if (!config->ReadLevel(0, map_config) && !config->ReadMapConfig("map/map.tmx", map_config))
+	{
+		return false;
+	}
+
 	// 创建游戏图层
 	auto layer = GameLayer::create();
-	layer->SetMap(Config::GetInstance()->ReadMapConfig("map/map.tmx"));
+	layer->SetMap(map_config);
 	addChild(layer);
 
 	return true;
@@ -0,0 +1,125 @@
+﻿/**
+ * 预编译的二进制关卡
+ * 固定长度的文件头加上按位存储的有效区域，可直接映射后使用，不需要解析与解压
+ * 文件头按小端序存储，有效区域按行优先顺序每格一位，低位在前
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "Types.h"
+
+/* 关卡文件标识 "ELLV" */
+static const uint32_t LEVEL_MAGIC = 0x564c4c45;
+
+/* 关卡文件版本 */
+static const uint16_t LEVEL_VERSION = 1;
+
+/* 关卡文件头 */
+struct LevelHeader
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint8_t		width;			// 地图列数
+	uint8_t		height;			// 地图行数
+	uint16_t	type_quantity;	// 类型数量
+	uint16_t	mask_size;		// 有效区域的字节数
+};
+
+static_assert(sizeof(LevelHeader) == 12, "unexpected level header layout");
+
+/* 游戏配置文件标识 "ELCF" */
+static const uint32_t GAME_CONFIG_MAGIC = 0x46434c45;
+
+/* 游戏配置文件版本 */
+static const uint16_t GAME_CONFIG_VERSION = 1;
+
+/* 二进制游戏配置，对应 config.json */
+struct GameConfigRecord
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	type_quantity;	// 类型数量上限
+	uint16_t	element_width;	// 元素宽度
+	uint16_t	element_height;	// 元素高度
+	float		move_time;		// 元素移动时间
+	float		fall_down_time;	// 元素落下时间
+};
+
+static_assert(sizeof(GameConfigRecord) == 20, "unexpected game config layout");
+
+/**
+ * 将地图配置编码为关卡数据（文件头 + 有效区域）
+ * 地图超出范围时抛出 std::runtime_error
+ */
+void EncodeLevel(const MapConfig &config, std::vector<uint8_t> &out);
+
+/**
+ * 保存关卡文件，失败时抛出 std::runtime_error
+ */
+void SaveLevel(const MapConfig &config, const std::string &filename);
+
+/**
+ * 映射并读取关卡文件，失败时抛出 std::runtime_error
+ */
+MapConfig LoadLevel(const std::string &filename);
+
+/**
+ * 数据是否以关卡文件标识开头
+ */
+bool IsLevelData(const void *data, size_t size);
+
+/* 关卡数据视图，直接引用外部内存，不复制 */
+class LevelView
+{
+public:
+	LevelView();
+
+public:
+	/**
+	 * 打开关卡数据，数据在使用期间必须有效
+	 * @return 文件头无效或长度不符时返回false
+	 */
+	bool Open(const void *data, size_t size);
+
+	const LevelHeader& GetHeader() const { return header_; }
+
+	int GetWidth() const { return header_.width; }
+
+	int GetHeight() const { return header_.height; }
+
+	int GetTypeQuantity() const { return header_.type_quantity; }
+
+	/**
+	 * 格子是否为有效区域
+	 */
+	bool IsValid(int row, int col) const
+	{
+		const unsigned int bit = row * header_.width + col;
+		return (mask_[bit >> 3] >> (bit & 7)) & 1;
+	}
+
+	/**
+	 * 转换为地图配置
+	 */
+	void ToMapConfig(MapConfig &config) const;
+
+private:
+	LevelHeader		header_;
+	const uint8_t*	mask_;
+};
+
+/**
+ * 编码游戏配置
+ */
+void EncodeGameConfig(const GameConfigRecord &record, std::vector<uint8_t> &out);
+
+/**
+ * 读取游戏配置
+ * @return 标识、版本或长度不符时返回false
+ */
+bool DecodeGameConfig(const void *data, size_t size, GameConfigRecord &record);
@@ -0,0 +1,165 @@
+﻿#include "Level.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "Misc/MappedFile.h"
+
+// 编码关卡数据
+void EncodeLevel(const MapConfig &config, std::vector<uint8_t> &out)
+{
+	if (config.width <= 0 || config.height <= 0 || config.width > MAX_MAP_COLS || config.height > MAX_MAP_ROWS
+		|| config.type_quantity <= 0 || config.type_quantity > 0xffff
+		|| config.data.size() != static_cast<size_t>(config.width * config.height))
+	{
+		throw std::runtime_error("invalid map config!");
+	}
+
+	const size_t cells = config.data.size();
+	LevelHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = LEVEL_MAGIC;
+	header.version = LEVEL_VERSION;
+	header.width = static_cast<uint8_t>(config.width);
+	header.height = static_cast<uint8_t>(config.height);
+	header.type_quantity = static_cast<uint16_t>(config.type_quantity);
+	header.mask_size = static_cast<uint16_t>((cells + 7) / 8);
+
+	out.assign(sizeof(LevelHeader) + header.mask_size, 0);
+	memcpy(&out[0], &header, sizeof(header));
+
+	uint8_t *mask = &out[sizeof(LevelHeader)];
+	for (size_t idx = 0; idx < cells; ++idx)
+	{
+		if (config.data[idx])
+		{
+			mask[idx >> 3] |= static_cast<uint8_t>(1 << (idx & 7));
+		}
+	}
+}
+
+// 保存关卡文件
+void SaveLevel(const MapConfig &config, const std::string &filename)
+{
+	std::vector<uint8_t> data;
+	EncodeLevel(config, data);
+
+	FILE *file = fopen(filename.c_str(), "wb");
+	if (file == nullptr)
+	{
+		throw std::runtime_error("can't open level file: " + filename);
+	}
+
+	const bool ok = fwrite(&data[0], 1, data.size(), file) == data.size();
+	fclose(file);
+	if (!ok)
+	{
+		throw std::runtime_error("can't write level file: " + filename);
+	}
+}
+
+// 读取关卡文件
+MapConfig LoadLevel(const std::string &filename)
+{
+	MappedFile file;
+	file.Open(filename);
+
+	LevelView view;
+	if (!view.Open(file.GetData(), file.GetSize()))
+	{
+		throw std::runtime_error("invalid level file: " + filename);
+	}
+
+	MapConfig config;
+	view.ToMapConfig(config);
+	return config;
+}
+
+// 是否为关卡数据
+bool IsLevelData(const void *data, size_t size)
+{
+	uint32_t magic = 0;
+	if (data == nullptr || size < sizeof(magic))
+	{
+		return false;
+	}
+	memcpy(&magic, data, sizeof(magic));
+	return magic == LEVEL_MAGIC;
+}
+
+/************************************************************************/
+
+LevelView::LevelView()
+	: mask_(nullptr)
+{
+	memset(&header_, 0, sizeof(header_));
+}
+
+// 打开关卡数据
+bool LevelView::Open(const void *data, size_t size)
+{
+	mask_ = nullptr;
+	if (data == nullptr || size < sizeof(LevelHeader))
+	{
+		return false;
+	}
+
+	memcpy(&header_, data, sizeof(header_));
+	if (header_.magic != LEVEL_MAGIC || header_.version != LEVEL_VERSION
+		|| header_.width == 0 || header_.height == 0
+		|| header_.width > MAX_MAP_COLS || header_.height > MAX_MAP_ROWS
+		|| header_.type_quantity == 0
+		|| header_.mask_size != (header_.width * header_.height + 7) / 8
+		|| size - sizeof(LevelHeader) != header_.mask_size)
+	{
+		memset(&header_, 0, sizeof(header_));
+		return false;
+	}
+
+	mask_ = static_cast<const uint8_t *>(data) + sizeof(LevelHeader);
+	return true;
+}
+
+// 转换为地图配置
+void LevelView::ToMapConfig(MapConfig &config) const
+{
+	config.width = header_.width;
+	config.height = header_.height;
+	config.type_quantity = header_.type_quantity;
+
+	const size_t cells = static_cast<size_t>(header_.width) * header_.height;
+	config.data.assign(cells, false);
+	for (size_t idx = 0; idx < cells; ++idx)
+	{
+		if ((mask_[idx >> 3] >> (idx & 7)) & 1)
+		{
+			config.data[idx] = true;
+		}
+	}
+}
+
+/************************************************************************/
+
+// 编码游戏配置
+void EncodeGameConfig(const GameConfigRecord &record, std::vector<uint8_t> &out)
+{
+	GameConfigRecord copy = record;
+	copy.magic = GAME_CONFIG_MAGIC;
+	copy.version = GAME_CONFIG_VERSION;
+	out.assign(sizeof(copy), 0);
+	memcpy(&out[0], &copy, sizeof(copy));
+}
+
+// 读取游戏配置
+bool DecodeGameConfig(const void *data, size_t size, GameConfigRecord &record)
+{
+	if (data == nullptr || size != sizeof(GameConfigRecord))
+	{
+		return false;
+	}
+
+	memcpy(&record, data, sizeof(record));
+	return record.magic == GAME_CONFIG_MAGIC && record.version == GAME_CONFIG_VERSION
+		&& record.type_quantity > 0 && record.element_width > 0 && record.element_height > 0;
+}
@@ -0,0 +1,313 @@
+﻿#include "LevelPack.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	const size_t kNoLevel = static_cast<size_t>(-1);
+}
+
+// 编码关卡包
+void EncodeLevelPack(const std::vector<MapConfig> &levels, std::vector<uint8_t> &out)
+{
+	LevelPackHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = LEVEL_PACK_MAGIC;
+	header.version = LEVEL_PACK_VERSION;
+	header.level_count = static_cast<uint32_t>(levels.size());
+
+	const size_t index_size = sizeof(LevelPackEntry) * levels.size();
+	out.assign(sizeof(LevelPackHeader) + index_size, 0);
+	memcpy(&out[0], &header, sizeof(header));
+
+	std::vector<uint8_t> level;
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		EncodeLevel(levels[i], level);
+
+		LevelPackEntry entry;
+		entry.offset = static_cast<uint32_t>(out.size());
+		entry.size = static_cast<uint32_t>(level.size());
+		memcpy(&out[sizeof(LevelPackHeader) + sizeof(LevelPackEntry) * i], &entry, sizeof(entry));
+		out.insert(out.end(), level.begin(), level.end());
+	}
+}
+
+// 保存关卡包
+void SaveLevelPack(const std::vector<MapConfig> &levels, const std::string &filename)
+{
+	std::vector<uint8_t> data;
+	EncodeLevelPack(levels, data);
+
+	FILE *file = fopen(filename.c_str(), "wb");
+	if (file == nullptr)
+	{
+		throw std::runtime_error("can't open level pack: " + filename);
+	}
+
+	const bool ok = fwrite(&data[0], 1, data.size(), file) == data.size();
+	fclose(file);
+	if (!ok)
+	{
+		throw std::runtime_error("can't write level pack: " + filename);
+	}
+}
+
+/************************************************************************/
+
+LevelPack::LevelPack(size_t cache_capacity)
+	: data_(nullptr)
+	, size_(0)
+	, level_count_(0)
+	, cache_capacity_(std::max<size_t>(cache_capacity, 1))
+	, loading_(kNoLevel)
+	, stop_(false)
+{
+	cache_.reserve(cache_capacity_);
+}
+
+LevelPack::~LevelPack()
+{
+	Close();
+}
+
+// 映射关卡包文件
+void LevelPack::Open(const std::string &filename)
+{
+	Close();
+
+	file_.Open(filename);
+	if (!Attach(file_.GetData(), file_.GetSize()))
+	{
+		file_.Close();
+		throw std::runtime_error("invalid level pack: " + filename);
+	}
+}
+
+// 打开内存中的关卡包
+bool LevelPack::Open(const void *data, size_t size)
+{
+	Close();
+	return Attach(data, size);
+}
+
+// 检查文件头并引用数据
+bool LevelPack::Attach(const void *data, size_t size)
+{
+	if (data == nullptr || size < sizeof(LevelPackHeader))
+	{
+		return false;
+	}
+
+	LevelPackHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != LEVEL_PACK_MAGIC || header.version != LEVEL_PACK_VERSION
+		|| (size - sizeof(LevelPackHeader)) / sizeof(LevelPackEntry) < header.level_count)
+	{
+		return false;
+	}
+
+	// 索引项在读取关卡时再检查，打开的耗时与关卡数量无关
+	data_ = static_cast<const uint8_t *>(data);
+	size_ = size;
+	level_count_ = header.level_count;
+	return true;
+}
+
+// 关闭关卡包
+void LevelPack::Close()
+{
+	StopPrefetch();
+	cache_.clear();
+	data_ = nullptr;
+	size_ = 0;
+	level_count_ = 0;
+	file_.Close();
+}
+
+// 获取关卡
+LevelPack::LevelPtr LevelPack::GetLevel(size_t index)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;)
+	{
+		LevelPtr level = Find(index);
+		if (level)
+		{
+			return level;
+		}
+		if (loading_ != index)
+		{
+			break;
+		}
+		loaded_cond_.wait(lock);
+	}
+	lock.unlock();
+
+	LevelPtr level = Decode(index);
+
+	lock.lock();
+	Insert(index, level);
+	return level;
+}
+
+// 后台预取关卡
+void LevelPack::Prefetch(size_t index)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (index >= level_count_ || index == loading_
+		|| std::find(pending_.begin(), pending_.end(), index) != pending_.end())
+	{
+		return;
+	}
+	for (size_t i = 0; i < cache_.size(); ++i)
+	{
+		if (cache_[i].first == index)
+		{
+			return;
+		}
+	}
+
+	// 第一次预取时才创建线程
+	if (!thread_.joinable())
+	{
+		stop_ = false;
+		thread_ = std::thread(&LevelPack::PrefetchThread, this);
+	}
+	pending_.push_back(index);
+	pending_cond_.notify_one();
+}
+
+// 关卡是否已缓存
+bool LevelPack::IsCached(size_t index) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (size_t i = 0; i < cache_.size(); ++i)
+	{
+		if (cache_[i].first == index)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// 解码关卡
+LevelPack::LevelPtr LevelPack::Decode(size_t index) const
+{
+	if (index >= level_count_)
+	{
+		throw std::runtime_error("level index out of range!");
+	}
+
+	LevelPackEntry entry;
+	memcpy(&entry, data_ + sizeof(LevelPackHeader) + sizeof(LevelPackEntry) * index, sizeof(entry));
+
+	LevelView view;
+	if (entry.offset > size_ || entry.size > size_ - entry.offset
+		|| !view.Open(data_ + entry.offset, entry.size))
+	{
+		throw std::runtime_error("corrupted level in pack!");
+	}
+
+	std::shared_ptr<MapConfig> level = std::make_shared<MapConfig>();
+	view.ToMapConfig(*level);
+	return level;
+}
+
+// 查找缓存
+LevelPack::LevelPtr LevelPack::Find(size_t index)
+{
+	for (size_t i = 0; i < cache_.size(); ++i)
+	{
+		if (cache_[i].first == index)
+		{
+			std::rotate(cache_.begin(), cache_.begin() + i, cache_.begin() + i + 1);
+			return cache_.front().second;
+		}
+	}
+	return LevelPtr();
+}
+
+// 放入缓存
+void LevelPack::Insert(size_t index, const LevelPtr &level)
+{
+	for (size_t i = 0; i < cache_.size(); ++i)
+	{
+		if (cache_[i].first == index)
+		{
+			cache_.erase(cache_.begin() + i);
+			break;
+		}
+	}
+	if (cache_.size() >= cache_capacity_)
+	{
+		cache_.pop_back();
+	}
+	cache_.insert(cache_.begin(), CacheEntry(index, level));
+}
+
+// 预取线程
+void LevelPack::PrefetchThread()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;)
+	{
+		while (!stop_ && pending_.empty())
+		{
+			pending_cond_.wait(lock);
+		}
+		if (stop_)
+		{
+			break;
+		}
+
+		const size_t index = pending_.front();
+		pending_.pop_front();
+		if (Find(index))
+		{
+			continue;
+		}
+
+		loading_ = index;
+		lock.unlock();
+
+		LevelPtr level;
+		try
+		{
+			level = Decode(index);
+		}
+		catch (const std::exception &)
+		{
+			// 损坏的关卡留给 GetLevel 报告
+		}
+
+		lock.lock();
+		if (level)
+		{
+			Insert(index, level);
+		}
+		loading_ = kNoLevel;
+		loaded_cond_.notify_all();
+	}
+}
+
+// 停止预取线程
+void LevelPack::StopPrefetch()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+		pending_.clear();
+	}
+	pending_cond_.notify_one();
+
+	if (thread_.joinable())
+	{
+		thread_.join();
+	}
+	stop_ = false;
+}
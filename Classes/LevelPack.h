@@ -0,0 +1,146 @@
+﻿/**
+ * 关卡包
+ * 多个二进制关卡合并为一个文件，文件头之后为偏移索引，打开时只读取索引，关卡按需解码
+ * 解码后的关卡保存在小型 LRU 缓存中，可在后台线程预取下一关
+ */
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <condition_variable>
+
+#include "Level.h"
+#include "Misc/MappedFile.h"
+#include "Misc/NonCopyable.h"
+
+/* 关卡包文件标识 "ELPK" */
+static const uint32_t LEVEL_PACK_MAGIC = 0x4b504c45;
+
+/* 关卡包文件版本 */
+static const uint16_t LEVEL_PACK_VERSION = 1;
+
+/* 关卡包文件头，之后为 level_count 个索引项 */
+struct LevelPackHeader
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	reserved;
+	uint32_t	level_count;	// 关卡数量
+};
+
+static_assert(sizeof(LevelPackHeader) == 12, "unexpected level pack header layout");
+
+/* 关卡包索引项 */
+struct LevelPackEntry
+{
+	uint32_t	offset;			// 关卡数据相对文件起始的偏移
+	uint32_t	size;			// 关卡数据的字节数
+};
+
+static_assert(sizeof(LevelPackEntry) == 8, "unexpected level pack entry layout");
+
+/**
+ * 将多个地图配置编码为关卡包
+ * 地图超出范围时抛出 std::runtime_error
+ */
+void EncodeLevelPack(const std::vector<MapConfig> &levels, std::vector<uint8_t> &out);
+
+/**
+ * 保存关卡包，失败时抛出 std::runtime_error
+ */
+void SaveLevelPack(const std::vector<MapConfig> &levels, const std::string &filename);
+
+class LevelPack : public NonCopyable
+{
+public:
+	typedef std::shared_ptr<const MapConfig> LevelPtr;
+
+	/**
+	 * @param cache_capacity 缓存的关卡数量
+	 */
+	explicit LevelPack(size_t cache_capacity = 4);
+	~LevelPack();
+
+public:
+	/**
+	 * 映射关卡包文件，只检查文件头与索引的长度
+	 * 打开失败时抛出 std::runtime_error
+	 */
+	void Open(const std::string &filename);
+
+	/**
+	 * 打开内存中的关卡包，数据在关闭前必须有效
+	 * @return 文件头无效或索引超出数据范围时返回false
+	 */
+	bool Open(const void *data, size_t size);
+
+	/**
+	 * 停止预取并关闭关卡包，已返回的关卡仍然有效
+	 */
+	void Close();
+
+	bool IsOpen() const { return data_ != nullptr; }
+
+	size_t GetLevelCount() const { return level_count_; }
+
+	/**
+	 * 获取关卡，未缓存时在当前线程解码
+	 * 正在后台预取时等待预取完成
+	 * 索引越界或数据损坏时抛出 std::runtime_error
+	 */
+	LevelPtr GetLevel(size_t index);
+
+	/**
+	 * 在后台线程解码关卡并放入缓存，已缓存或越界时忽略
+	 */
+	void Prefetch(size_t index);
+
+	/**
+	 * 关卡是否已在缓存中
+	 */
+	bool IsCached(size_t index) const;
+
+private:
+	/* 检查文件头与索引长度并引用数据 */
+	bool Attach(const void *data, size_t size);
+
+	/* 解码关卡，只读取打开后不变的数据，不需要加锁 */
+	LevelPtr Decode(size_t index) const;
+
+	/* 查找缓存并移到最前，调用时需持有锁 */
+	LevelPtr Find(size_t index);
+
+	/* 放入缓存并淘汰最久未使用的关卡，调用时需持有锁 */
+	void Insert(size_t index, const LevelPtr &level);
+
+	/* 预取线程 */
+	void PrefetchThread();
+
+	/* 停止预取线程 */
+	void StopPrefetch();
+
+private:
+	typedef std::pair<size_t, LevelPtr> CacheEntry;
+
+	MappedFile					file_;
+	const uint8_t*				data_;
+	size_t						size_;
+	size_t						level_count_;
+
+	size_t						cache_capacity_;
+	std::vector<CacheEntry>		cache_;				// 按最近使用顺序排列
+	std::deque<size_t>			pending_;			// 等待预取的关卡
+	size_t						loading_;			// 正在预取的关卡
+	bool						stop_;
+	std::thread					thread_;
+	mutable std::mutex			mutex_;
+	std::condition_variable		pending_cond_;
+	std::condition_variable		loaded_cond_;
+};
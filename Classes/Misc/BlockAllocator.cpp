@@ -1,81 +1,439 @@
 ﻿#include <limits.h>
 #include <memory.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <assert.h>
+#include <new>
+#include <atomic>
+#include <stdexcept>
+#include <algorithm>
 #include "BlockAllocator.h"
 
-int BlockAllocator::block_sizes_[g_block_sizes] =
-{
-	16,		// 0
-	32,		// 1
-	64,		// 2
-	96,		// 3
-	128,	// 4
-	160,	// 5
-	192,	// 6
-	224,	// 7
-	256,	// 8
-	320,	// 9
-	384,	// 10
-	448,	// 11
-	512,	// 12
-	640,	// 13
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+struct Block
+{
+	Block *next;
 };
-char BlockAllocator::s_block_size_lookup_[g_max_block_size + 1];
-bool BlockAllocator::s_block_size_lookup_initialized_;
 
+struct Arena;
+
+/* chunk 头部，位于按 chunk_size 对齐的 chunk 起始处，块从 g_chunk_header_size 之后开始 */
 struct Chunk
 {
-	int block_size;
-	Block *blocks;
+	int		block_size;
+	int		block_count;
+	int		live;			// 已分配的块数
+	int		index;			// 在 chunks_ 中的位置
+	Block*	free_list;		// 本 chunk 的空闲块
+	Chunk*	prev;			// 同规格中有空闲块的 chunk
+	Chunk*	next;
+	Arena*	arena;			// 所在的 arena，单独申请时为空
 };
 
-struct Block
+/* 一次映射的大块内存，按 chunk_size 切分 */
+struct Arena
 {
-	Block *next;
+	void*	base;			// 映射的起始地址与长度，用于释放
+	size_t	mapped;
+	char*	start;			// 第一个 chunk
+	int		chunk_count;	// 可切分的 chunk 数量
+	int		carved;			// 已切分过的 chunk 数量
+	int		used;			// 正在使用的 chunk 数量
+	std::vector<Chunk*>	free_chunks;	// 回收的 chunk，内容已交还系统，不能在其中保存链表
 };
 
+static_assert(sizeof(Chunk) <= g_chunk_header_size, "chunk header too large");
+static_assert((g_chunk_size & (g_chunk_size - 1)) == 0, "chunk size must be a power of two");
+
+namespace
+{
+	const int kDefaultBlockSizes[g_block_sizes] =
+	{
+		16,		// 0
+		32,		// 1
+		64,		// 2
+		96,		// 3
+		128,	// 4
+		160,	// 5
+		192,	// 6
+		224,	// 7
+		256,	// 8
+		320,	// 9
+		384,	// 10
+		448,	// 11
+		512,	// 12
+		640,	// 13
+	};
+
+	const size_t kHugePageSize = 2 * 1024 * 1024;
+
+	/**
+	 * 向系统申请按 alignment 对齐的内存
+	 * @param base 输出实际映射的地址，释放时使用
+	 * @param mapped 输出实际映射的长度
+	 */
+	void* MapMemory(size_t size, size_t alignment, ArenaPages pages, void *&base, size_t &mapped)
+	{
+#ifdef _WIN32
+		if (pages == PAGES_HUGE)
+		{
+			const SIZE_T large_page = GetLargePageMinimum();
+			if (large_page != 0 && size % large_page == 0)
+			{
+				void *p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+				if (p && ((uintptr_t)p & (alignment - 1)) == 0)
+				{
+					base = p;
+					mapped = size;
+					return p;
+				}
+				if (p) VirtualFree(p, 0, MEM_RELEASE);
+			}
+		}
+
+		// 不能只释放映射的一部分，多申请一段用于对齐
+		void *p = VirtualAlloc(nullptr, size + alignment, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (p == nullptr)
+		{
+			return nullptr;
+		}
+		base = p;
+		mapped = size + alignment;
+		return (void *)(((uintptr_t)p + alignment - 1) & ~uintptr_t(alignment - 1));
+#else
+#ifdef MAP_HUGETLB
+		if (pages == PAGES_HUGE && size % kHugePageSize == 0)
+		{
+			void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (p != MAP_FAILED && ((uintptr_t)p & (alignment - 1)) == 0)
+			{
+				base = p;
+				mapped = size;
+				return p;
+			}
+			if (p != MAP_FAILED) munmap(p, size);
+		}
+#endif
+
+		// 多映射一段，裁掉首尾使起始地址对齐
+		const size_t length = size + alignment;
+		void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+		{
+			return nullptr;
+		}
+
+		const uintptr_t start = (uintptr_t)p;
+		const uintptr_t aligned = (start + alignment - 1) & ~uintptr_t(alignment - 1);
+		if (aligned > start)
+		{
+			munmap(p, aligned - start);
+		}
+		if (start + length > aligned + size)
+		{
+			munmap((void *)(aligned + size), start + length - aligned - size);
+		}
+
+#ifdef MADV_HUGEPAGE
+		if (pages != PAGES_NORMAL)
+		{
+			madvise((void *)aligned, size, MADV_HUGEPAGE);
+		}
+#endif
+		base = (void *)aligned;
+		mapped = size;
+		return base;
+#endif
+	}
+
+	void UnmapMemory(void *base, size_t mapped)
+	{
+#ifdef _WIN32
+		VirtualFree(base, 0, MEM_RELEASE);
+#else
+		munmap(base, mapped);
+#endif
+	}
+
+	/**
+	 * 不使用 arena 时单独申请一个 chunk
+	 * 从 C 运行库申请对齐内存，避免每个 chunk 一次映射，释放单个 chunk 时也不会拆分映射区域
+	 */
+	void* AllocateChunkMemory(int chunk_size)
+	{
+#ifdef _WIN32
+		return _aligned_malloc(chunk_size, chunk_size);
+#else
+		void *p = nullptr;
+		return posix_memalign(&p, chunk_size, chunk_size) == 0 ? p : nullptr;
+#endif
+	}
+
+	void FreeChunkMemory(void *p)
+	{
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+
+	/* 将 arena 中空闲 chunk 的物理页交还系统，保留地址与映射 */
+	void DiscardChunkMemory(void *p, int chunk_size)
+	{
+#ifdef _WIN32
+		VirtualAlloc(p, chunk_size, MEM_RESET, PAGE_READWRITE);
+#else
+		madvise(p, chunk_size, MADV_DONTNEED);
+#endif
+	}
+
+	inline void LinkChunk(Chunk *&head, Chunk *chunk)
+	{
+		chunk->prev = nullptr;
+		chunk->next = head;
+		if (head) head->prev = chunk;
+		head = chunk;
+	}
+
+	inline void UnlinkChunk(Chunk *&head, Chunk *chunk)
+	{
+		if (chunk->prev) chunk->prev->next = chunk->next;
+		else head = chunk->next;
+		if (chunk->next) chunk->next->prev = chunk->prev;
+		chunk->prev = chunk->next = nullptr;
+	}
+}
+
+BlockAllocatorConfig::BlockAllocatorConfig()
+	: chunk_size(g_chunk_size)
+	, block_sizes(kDefaultBlockSizes, kDefaultBlockSizes + g_block_sizes)
+	, arena_size(g_arena_size)
+	, pages(PAGES_NORMAL)
+{
+}
+
 BlockAllocator::BlockAllocator()
+	: BlockAllocator(BlockAllocatorConfig())
 {
-	assert(g_block_sizes < UCHAR_MAX);
+}
+
+BlockAllocator::BlockAllocator(const BlockAllocatorConfig &config)
+	: config_(config)
+	, current_arena_(nullptr)
+{
+	const int chunk_size = config.chunk_size;
+	const int class_count = static_cast<int>(config.block_sizes.size());
+	if (chunk_size < 1024 || (chunk_size & (chunk_size - 1)) != 0
+		|| class_count == 0 || class_count > g_max_size_classes
+		|| (config.arena_size != 0 && (config.arena_size < size_t(chunk_size) || config.arena_size % chunk_size != 0)))
+	{
+		throw std::runtime_error("invalid allocator config!");
+	}
+	for (int i = 0; i < class_count; ++i)
+	{
+		const int block_size = config.block_sizes[i];
+		if (block_size <= 0 || block_size % 16 != 0 || block_size > chunk_size - g_chunk_header_size
+			|| (i > 0 && block_size <= config.block_sizes[i - 1]))
+		{
+			throw std::runtime_error("invalid allocator config!");
+		}
+		block_sizes_[i] = block_size;
+	}
+
+	chunk_mask_ = ~size_t(chunk_size - 1);
+	class_count_ = class_count;
+	max_block_size_ = block_sizes_[class_count - 1];
+
+	// 块大小都是16的倍数，按16字节为单位建立查找表
+	size_lookup_.resize(max_block_size_ / 16 + 1);
+	int j = 0;
+	for (int i = 0; i < static_cast<int>(size_lookup_.size()); ++i)
+	{
+		while (i * 16 > block_sizes_[j])
+		{
+			++j;
+		}
+		size_lookup_[i] = (unsigned char)j;
+	}
 
 	num_chunk_space_ = g_chunk_array_increment;
 	num_chunk_count_ = 0;
-	chunks_ = (Chunk *)malloc(num_chunk_space_ * sizeof(Chunk));
+	chunks_ = (Chunk **)malloc(num_chunk_space_ * sizeof(Chunk *));
 
-	memset(chunks_, 0, num_chunk_space_ * sizeof(Chunk));
-	memset(free_lists_, 0, sizeof(free_lists_));
+	memset(chunks_, 0, num_chunk_space_ * sizeof(Chunk *));
+	memset(free_chunks_, 0, sizeof(free_chunks_));
+	memset(allocations_, 0, sizeof(allocations_));
+	memset(frees_, 0, sizeof(frees_));
+	memset(peak_live_blocks_, 0, sizeof(peak_live_blocks_));
+	large_allocations_ = 0;
+	large_frees_ = 0;
+	large_bytes_ = 0;
+}
+
+BlockAllocator::~BlockAllocator()
+{
+	Clear();
 
-	if (s_block_size_lookup_initialized_ == false)
+	::free(chunks_);
+}
+
+Chunk* BlockAllocator::GetChunk(void *p) const
+{
+	return (Chunk *)((uintptr_t)p & chunk_mask_);
+}
+
+void* BlockAllocator::AllocateFromArena(Arena *&arena)
+{
+	// 优先使用最近的 arena，其次是有回收 chunk 的 arena
+	arena = current_arena_;
+	if (arena == nullptr || (arena->free_chunks.empty() && arena->carved == arena->chunk_count))
 	{
-		int j = 0;
-		for (int i = 1; i <= g_max_block_size; ++i)
+		arena = nullptr;
+		for (size_t i = 0; i < arenas_.size(); ++i)
 		{
-			assert(j < g_block_sizes);
-			if (i <= block_sizes_[j])
+			if (!arenas_[i]->free_chunks.empty() || arenas_[i]->carved < arenas_[i]->chunk_count)
 			{
-				s_block_size_lookup_[i] = (char)j;
-			}
-			else
-			{
-				++j;
-				s_block_size_lookup_[i] = (char)j;
+				arena = arenas_[i];
+				break;
 			}
 		}
+	}
+
+	if (arena == nullptr)
+	{
+		// chunk 必须按 chunk_size 对齐，大页对齐只能在此基础上加强
+		const size_t alignment = config_.pages != PAGES_NORMAL && config_.arena_size % kHugePageSize == 0
+			? std::max(kHugePageSize, size_t(config_.chunk_size)) : size_t(config_.chunk_size);
+		void *base = nullptr;
+		size_t mapped = 0;
+		char *start = (char *)MapMemory(config_.arena_size, alignment, config_.pages, base, mapped);
+		if (start == nullptr)
+		{
+			return nullptr;
+		}
+
+		arena = new Arena;
+		arena->base = base;
+		arena->mapped = mapped;
+		arena->start = start;
+		arena->chunk_count = static_cast<int>(config_.arena_size / config_.chunk_size);
+		arena->carved = 0;
+		arena->used = 0;
+		arenas_.push_back(arena);
+	}
+	current_arena_ = arena;
+
+	void *p = nullptr;
+	if (!arena->free_chunks.empty())
+	{
+		p = arena->free_chunks.back();
+		arena->free_chunks.pop_back();
+	}
+	else
+	{
+		p = arena->start + size_t(arena->carved++) * config_.chunk_size;
+	}
+	++arena->used;
+	return p;
+}
 
-		s_block_size_lookup_initialized_ = true;
+void BlockAllocator::ReleaseArena(Arena *arena)
+{
+	if (current_arena_ == arena)
+	{
+		current_arena_ = nullptr;
 	}
+	arenas_.erase(std::find(arenas_.begin(), arenas_.end(), arena));
+	UnmapMemory(arena->base, arena->mapped);
+	delete arena;
 }
 
-BlockAllocator::~BlockAllocator()
+Chunk* BlockAllocator::NewChunk(int index)
 {
-	for (int i = 0; i < num_chunk_count_; ++i)
+	if (num_chunk_count_ == num_chunk_space_)
 	{
-		::free(chunks_[i].blocks);
+		Chunk **oldChunks = chunks_;
+		num_chunk_space_ += g_chunk_array_increment;
+		chunks_ = (Chunk **)malloc(num_chunk_space_ * sizeof(Chunk *));
+		memcpy(chunks_, oldChunks, num_chunk_count_ * sizeof(Chunk *));
+		memset(chunks_ + num_chunk_count_, 0, g_chunk_array_increment * sizeof(Chunk *));
+		::free(oldChunks);
 	}
 
-	::free(chunks_);
+	Arena *arena = nullptr;
+	Chunk *chunk = (Chunk *)(config_.arena_size != 0
+		? AllocateFromArena(arena)
+		: AllocateChunkMemory(config_.chunk_size));
+	if (chunk == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+#if defined(_DEBUG)
+	memset(chunk, 0xcd, config_.chunk_size);
+#endif
+
+	int block_size = block_sizes_[index];
+	int block_count = (config_.chunk_size - g_chunk_header_size) / block_size;
+	char *blocks = (char *)chunk + g_chunk_header_size;
+	for (int i = 0; i < block_count - 1; ++i)
+	{
+		Block *block = (Block *)(blocks + block_size * i);
+		Block *next = (Block *)(blocks + block_size * (i + 1));
+		block->next = next;
+	}
+	Block *last = (Block *)(blocks + block_size * (block_count - 1));
+	last->next = nullptr;
+
+	chunk->block_size = block_size;
+	chunk->block_count = block_count;
+	chunk->live = 0;
+	chunk->index = num_chunk_count_;
+	chunk->free_list = (Block *)blocks;
+	chunk->arena = arena;
+	LinkChunk(free_chunks_[index], chunk);
+
+	chunks_[num_chunk_count_++] = chunk;
+	return chunk;
+}
+
+void BlockAllocator::DeleteChunk(Chunk *chunk)
+{
+	// 用最后一个 chunk 填补空位
+	Chunk *last = chunks_[--num_chunk_count_];
+	chunks_[chunk->index] = last;
+	last->index = chunk->index;
+	chunks_[num_chunk_count_] = nullptr;
+
+	Arena *arena = chunk->arena;
+	if (arena == nullptr)
+	{
+		FreeChunkMemory(chunk);
+		return;
+	}
+
+	if (--arena->used == 0)
+	{
+		ReleaseArena(arena);
+		return;
+	}
+
+	// arena 仍在使用时只交还物理页，不拆分映射；大页不能部分交还
+	arena->free_chunks.push_back(chunk);
+	if (config_.pages == PAGES_NORMAL)
+	{
+		DiscardChunkMemory(chunk, config_.chunk_size);
+	}
 }
 
 void* BlockAllocator::Allocate(int size)
@@ -85,55 +443,37 @@ void* BlockAllocator::Allocate(int size)
 
 	assert(0 < size);
 
-	if (size > g_max_block_size)
+	if (size > max_block_size_)
 	{
+#ifdef BLOCK_ALLOCATOR_STATS
+		++large_allocations_;
+		large_bytes_ += size;
+#endif
 		return malloc(size);
 	}
 
-	int index = s_block_size_lookup_[size];
-	assert(0 <= index && index < g_block_sizes);
+	int index = GetSizeIndex(size);
+	assert(0 <= index && index < class_count_);
 
-	if (free_lists_[index])
-	{
-		Block *block = free_lists_[index];
-		free_lists_[index] = block->next;
-		return block;
-	}
-	else
-	{
-		if (num_chunk_count_ == num_chunk_space_)
-		{
-			Chunk *oldChunks = chunks_;
-			num_chunk_space_ += g_chunk_array_increment;
-			chunks_ = (Chunk *)malloc(num_chunk_space_ * sizeof(Chunk));
-			memcpy(chunks_, oldChunks, num_chunk_count_ * sizeof(Chunk));
-			memset(chunks_ + num_chunk_count_, 0, g_chunk_array_increment * sizeof(Chunk));
-			::free(oldChunks);
-		}
-
-		Chunk *chunk = chunks_ + num_chunk_count_;
-		chunk->blocks = (Block *)malloc(g_chunk_size);
-#if defined(_DEBUG)
-		memset(chunk->blocks, 0xcd, g_chunk_size);
+#ifdef BLOCK_ALLOCATOR_STATS
+	const long long live = ++allocations_[index] - frees_[index];
+	if (live > peak_live_blocks_[index]) peak_live_blocks_[index] = live;
 #endif
-		int block_size = block_sizes_[index];
-		chunk->block_size = block_size;
-		int block_count = g_chunk_size / block_size;
-		assert(block_count * block_size <= g_chunk_size);
-		for (int i = 0; i < block_count - 1; ++i)
-		{
-			Block *block = (Block *)((char *)chunk->blocks + block_size * i);
-			Block *next = (Block *)((char *)chunk->blocks + block_size * (i + 1));
-			block->next = next;
-		}
-		Block *last = (Block *)((char *)chunk->blocks + block_size * (block_count - 1));
-		last->next = nullptr;
 
-		free_lists_[index] = chunk->blocks->next;
-		++num_chunk_count_;
+	Chunk *chunk = free_chunks_[index];
+	if (chunk == nullptr)
+	{
+		chunk = NewChunk(index);
+	}
 
-		return chunk->blocks;
+	Block *block = chunk->free_list;
+	chunk->free_list = block->next;
+	if (++chunk->live == chunk->block_count)
+	{
+		// 已满的 chunk 移出链表，释放块时再加入
+		UnlinkChunk(free_chunks_[index], chunk);
 	}
+	return block;
 }
 
 void BlockAllocator::Free(void *p, int size)
@@ -145,54 +485,445 @@ void BlockAllocator::Free(void *p, int size)
 
 	assert(0 < size);
 
-	if (size > g_max_block_size)
+	if (size > max_block_size_)
 	{
+#ifdef BLOCK_ALLOCATOR_STATS
+		++large_frees_;
+		large_bytes_ -= size;
+#endif
 		::free(p);
 		return;
 	}
 
-	int index = s_block_size_lookup_[size];
-	assert(0 <= index && index < g_block_sizes);
+	int index = GetSizeIndex(size);
+	assert(0 <= index && index < class_count_);
+
+#ifdef BLOCK_ALLOCATOR_STATS
+	++frees_[index];
+#endif
+
+	Chunk *chunk = GetChunk(p);
 
 #ifdef _DEBUG
+	// chunk 按地址对齐，校验只需常数时间
 	int block_size = block_sizes_[index];
-	bool found = false;
+	const ptrdiff_t offset = (char *)p - ((char *)chunk + g_chunk_header_size);
+	assert(chunks_[chunk->index] == chunk);
+	assert(chunk->block_size == block_size);
+	assert(offset >= 0 && offset % block_size == 0 && offset / block_size < chunk->block_count);
+	assert(chunk->live > 0);
+
+	memset(p, 0xfd, block_size);
+#endif
+
+	Block *block = (Block *)p;
+	block->next = chunk->free_list;
+	chunk->free_list = block;
+	if (chunk->live-- == chunk->block_count)
+	{
+		LinkChunk(free_chunks_[index], chunk);
+	}
+}
+
+void BlockAllocator::Clear()
+{
 	for (int i = 0; i < num_chunk_count_; ++i)
 	{
-		Chunk *chunk = chunks_ + i;
-		if (chunk->block_size != block_size)
+		if (chunks_[i]->arena == nullptr)
 		{
-			assert((char *)p + block_size <= (char *)chunk->blocks ||
-				(char *)chunk->blocks + g_chunk_size <= (char *)p);
+			FreeChunkMemory(chunks_[i]);
 		}
-		else
+	}
+	for (size_t i = 0; i < arenas_.size(); ++i)
+	{
+		UnmapMemory(arenas_[i]->base, arenas_[i]->mapped);
+		delete arenas_[i];
+	}
+	arenas_.clear();
+	current_arena_ = nullptr;
+
+	num_chunk_count_ = 0;
+	memset(chunks_, 0, num_chunk_space_ * sizeof(Chunk *));
+
+	memset(free_chunks_, 0, sizeof(free_chunks_));
+	memset(allocations_, 0, sizeof(allocations_));
+	memset(frees_, 0, sizeof(frees_));
+	memset(peak_live_blocks_, 0, sizeof(peak_live_blocks_));
+}
+
+int BlockAllocator::Trim()
+{
+	int released = 0;
+	for (int i = num_chunk_count_ - 1; i >= 0; --i)
+	{
+		Chunk *chunk = chunks_[i];
+		if (chunk->live == 0)
 		{
-			if ((char *)chunk->blocks <= (char *)p && (char *)p + block_size <= (char *)chunk->blocks + g_chunk_size)
-			{
-				found = true;
-			}
+			UnlinkChunk(free_chunks_[GetSizeIndex(chunk->block_size)], chunk);
+			DeleteChunk(chunk);
+			++released;
 		}
 	}
+	return released;
+}
 
-	assert(found);
+void BlockAllocator::GetStats(AllocatorStats &stats) const
+{
+	memset(&stats, 0, sizeof(stats));
+#ifdef BLOCK_ALLOCATOR_STATS
+	stats.enabled = true;
+#endif
+	stats.chunk_size = config_.chunk_size;
+	stats.chunks = num_chunk_count_;
+	stats.arenas = static_cast<int>(arenas_.size());
+	for (size_t i = 0; i < arenas_.size(); ++i)
+	{
+		stats.arena_bytes += arenas_[i]->mapped;
+	}
+	stats.large_allocations = large_allocations_;
+	stats.large_frees = large_frees_;
+	stats.large_bytes = large_bytes_;
+	stats.class_count = class_count_;
 
-	memset(p, 0xfd, block_size);
+	for (int index = 0; index < class_count_; ++index)
+	{
+		AllocatorStats::SizeClass &size_class = stats.classes[index];
+		size_class.block_size = block_sizes_[index];
+		size_class.allocations = allocations_[index];
+		size_class.frees = frees_[index];
+		size_class.peak_live_blocks = peak_live_blocks_[index];
+	}
+
+	for (int i = 0; i < num_chunk_count_; ++i)
+	{
+		const Chunk *chunk = chunks_[i];
+		AllocatorStats::SizeClass &size_class = stats.classes[GetSizeIndex(chunk->block_size)];
+		++size_class.chunks;
+		size_class.live_blocks += chunk->live;
+		size_class.free_blocks += chunk->block_count - chunk->live;
+		if (chunk->live == 0) ++size_class.empty_chunks;
+		if (chunk->live == chunk->block_count) ++size_class.full_chunks;
+	}
+}
+
+void AllocatorStats::Dump(FILE *out) const
+{
+	fprintf(out, "size  chunks  empty   full        live        peak        free  occupancy        allocs         frees\n");
+	for (int index = 0; index < class_count; ++index)
+	{
+		const SizeClass &size_class = classes[index];
+		if (size_class.chunks == 0 && size_class.allocations == 0)
+		{
+			continue;
+		}
+		const long long capacity = size_class.live_blocks + size_class.free_blocks;
+		fprintf(out, "%4d  %6d  %5d  %5d  %10lld  %10lld  %10lld  %8.1f%%  %12lld  %12lld\n",
+			size_class.block_size, size_class.chunks, size_class.empty_chunks, size_class.full_chunks,
+			size_class.live_blocks, size_class.peak_live_blocks, size_class.free_blocks,
+			capacity > 0 ? 100.0 * size_class.live_blocks / capacity : 0.0,
+			size_class.allocations, size_class.frees);
+	}
+	fprintf(out, "chunks: %d (%lld KB)\n", chunks, (long long)chunks * (chunk_size / 1024));
+	if (arenas > 0)
+	{
+		fprintf(out, "arenas: %d (%lld KB mapped)\n", arenas, arena_bytes / 1024);
+	}
+	fprintf(out, "large:  %lld allocations, %lld frees, %lld bytes live\n", large_allocations, large_frees, large_bytes);
+	if (!enabled)
+	{
+		fprintf(out, "(allocation counts and peaks need BLOCK_ALLOCATOR_STATS)\n");
+	}
+}
+
+/************************************************************************/
+
+#ifdef BLOCK_ALLOCATOR_STATS
+/* 只由所属线程写入，其他线程汇总时读取，写入不需要加锁前缀的原子指令 */
+class StatCounter
+{
+public:
+	StatCounter() : value_(0) {}
+
+	void Add(long long n) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+	long long Get() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<long long> value_;
+};
+#endif
+
+struct ThreadCache
+{
+	Block*			lists[g_max_size_classes];
+	int				counts[g_max_size_classes];
+	ThreadCache*	next;
+
+#ifdef BLOCK_ALLOCATOR_STATS
+	StatCounter		allocations[g_max_size_classes];
+	StatCounter		frees[g_max_size_classes];
+	StatCounter		large_allocations;
+	StatCounter		large_frees;
+	StatCounter		large_bytes;
+#endif
+
+	ThreadCache()
+		: next(nullptr)
+	{
+		memset(lists, 0, sizeof(lists));
+		memset(counts, 0, sizeof(counts));
+	}
+};
+
+namespace
+{
+	SOA_THREAD_LOCAL ThreadCache *t_cache = nullptr;
+
+#if SOA_THREAD_EXIT_RELEASE
+	// 线程退出时归还缓存
+	struct ThreadCacheGuard
+	{
+		bool active = false;
+		~ThreadCacheGuard()
+		{
+			if (active && t_cache) SOA::GetInstance()->ReleaseThreadCache();
+		}
+	};
+	thread_local ThreadCacheGuard t_guard;
+#endif
+}
+
+namespace
+{
+	/* SOA 中心池的配置，只在创建实例前修改 */
+	BlockAllocatorConfig& GetSoaConfig()
+	{
+		static BlockAllocatorConfig config;
+		return config;
+	}
+}
+
+void SOA::SetConfig(const BlockAllocatorConfig &config)
+{
+	GetSoaConfig() = config;
+}
+
+SOA::SOA()
+	: central_(GetSoaConfig())
+	, caches_(nullptr)
+{
+	memset(&retired_, 0, sizeof(retired_));
+}
+
+SOA::~SOA()
+{
+	while (caches_)
+	{
+		ThreadCache *cache = caches_;
+		caches_ = cache->next;
+		delete cache;
+	}
+	t_cache = nullptr;
+}
+
+ThreadCache* SOA::GetThreadCache()
+{
+	if (t_cache == nullptr)
+	{
+		ThreadCache *cache = new ThreadCache;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			cache->next = caches_;
+			caches_ = cache;
+		}
+		t_cache = cache;
+#if SOA_THREAD_EXIT_RELEASE
+		t_guard.active = true;
 #endif
+	}
+	return t_cache;
+}
+
+void SOA::Refill(ThreadCache *cache, int index)
+{
+	const int block_size = central_.GetBlockSize(index);
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (int i = 0; i < g_thread_cache_batch; ++i)
+	{
+		Block *block = (Block *)central_.Allocate(block_size);
+		block->next = cache->lists[index];
+		cache->lists[index] = block;
+	}
+	cache->counts[index] += g_thread_cache_batch;
+}
+
+void SOA::Flush(ThreadCache *cache, int index, int count)
+{
+	const int block_size = central_.GetBlockSize(index);
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (int i = 0; i < count && cache->lists[index]; ++i)
+	{
+		Block *block = cache->lists[index];
+		cache->lists[index] = block->next;
+		--cache->counts[index];
+		central_.Free(block, block_size);
+	}
+}
+
+void* SOA::Allocate(int size)
+{
+	if (size == 0)
+		return nullptr;
+
+	assert(0 < size);
+
+	ThreadCache *cache = GetThreadCache();
+	if (size > central_.GetMaxBlockSize())
+	{
+#ifdef BLOCK_ALLOCATOR_STATS
+		cache->large_allocations.Add(1);
+		cache->large_bytes.Add(size);
+#endif
+		return malloc(size);
+	}
+
+	const int index = central_.GetSizeIndex(size);
+#ifdef BLOCK_ALLOCATOR_STATS
+	cache->allocations[index].Add(1);
+#endif
+	if (cache->lists[index] == nullptr)
+	{
+		Refill(cache, index);
+	}
 
+	Block *block = cache->lists[index];
+	cache->lists[index] = block->next;
+	--cache->counts[index];
+	return block;
+}
+
+void SOA::Free(void *p, int size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	assert(0 < size);
+
+	ThreadCache *cache = GetThreadCache();
+	if (size > central_.GetMaxBlockSize())
+	{
+#ifdef BLOCK_ALLOCATOR_STATS
+		cache->large_frees.Add(1);
+		cache->large_bytes.Add(-size);
+#endif
+		::free(p);
+		return;
+	}
+
+	const int index = central_.GetSizeIndex(size);
+#ifdef BLOCK_ALLOCATOR_STATS
+	cache->frees[index].Add(1);
+#endif
 	Block *block = (Block *)p;
-	block->next = free_lists_[index];
-	free_lists_[index] = block;
+	block->next = cache->lists[index];
+	cache->lists[index] = block;
+
+	// 缓存过多时归还一批，避免一个线程分配、另一个线程释放时无限增长
+	if (++cache->counts[index] >= g_thread_cache_batch * 2)
+	{
+		Flush(cache, index, g_thread_cache_batch);
+	}
 }
 
-void BlockAllocator::Clear()
+void SOA::Clear()
 {
-	for (int i = 0; i < num_chunk_count_; ++i)
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (ThreadCache *cache = caches_; cache; cache = cache->next)
 	{
-		::free(chunks_[i].blocks);
+		memset(cache->lists, 0, sizeof(cache->lists));
+		memset(cache->counts, 0, sizeof(cache->counts));
 	}
+	central_.Clear();
+}
 
-	num_chunk_count_ = 0;
-	memset(chunks_, 0, num_chunk_space_ * sizeof(Chunk));
+void SOA::ReleaseThreadCache()
+{
+	ThreadCache *cache = t_cache;
+	if (cache == nullptr)
+	{
+		return;
+	}
+
+	for (int index = 0; index < central_.GetSizeClassCount(); ++index)
+	{
+		Flush(cache, index, cache->counts[index]);
+	}
 
-	memset(free_lists_, 0, sizeof(free_lists_));
+	std::lock_guard<std::mutex> lock(mutex_);
+#ifdef BLOCK_ALLOCATOR_STATS
+	for (int index = 0; index < central_.GetSizeClassCount(); ++index)
+	{
+		retired_.classes[index].allocations += cache->allocations[index].Get();
+		retired_.classes[index].frees += cache->frees[index].Get();
+	}
+	retired_.large_allocations += cache->large_allocations.Get();
+	retired_.large_frees += cache->large_frees.Get();
+	retired_.large_bytes += cache->large_bytes.Get();
+#endif
+	for (ThreadCache **itr = &caches_; *itr; itr = &(*itr)->next)
+	{
+		if (*itr == cache)
+		{
+			*itr = cache->next;
+			break;
+		}
+	}
+	delete cache;
+	t_cache = nullptr;
+}
+
+int SOA::Trim()
+{
+	ReleaseThreadCache();
+	std::lock_guard<std::mutex> lock(mutex_);
+	return central_.Trim();
+}
+
+void SOA::GetStats(AllocatorStats &stats)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	central_.GetStats(stats);
+
+#ifdef BLOCK_ALLOCATOR_STATS
+	// 中心池的次数只反映批量转移，改为各线程的分配与释放次数
+	for (int index = 0; index < central_.GetSizeClassCount(); ++index)
+	{
+		stats.classes[index].allocations = retired_.classes[index].allocations;
+		stats.classes[index].frees = retired_.classes[index].frees;
+	}
+	stats.large_allocations = retired_.large_allocations;
+	stats.large_frees = retired_.large_frees;
+	stats.large_bytes = retired_.large_bytes;
+
+	for (ThreadCache *cache = caches_; cache; cache = cache->next)
+	{
+		for (int index = 0; index < central_.GetSizeClassCount(); ++index)
+		{
+			stats.classes[index].allocations += cache->allocations[index].Get();
+			stats.classes[index].frees += cache->frees[index].Get();
+		}
+		stats.large_allocations += cache->large_allocations.Get();
+		stats.large_frees += cache->large_frees.Get();
+		stats.large_bytes += cache->large_bytes.Get();
+	}
+#endif
+}
+
+void SOA::DumpStats(FILE *out)
+{
+	AllocatorStats stats;
+	GetStats(stats);
+	stats.Dump(out);
 }
\ No newline at end of file
@@ -1,12 +1,82 @@
 ﻿#pragma once
 
+#include <mutex>
+#include <cstdio>
+#include <cstddef>
+#include <vector>
 #include "Singleton.h"
 #include "NonCopyable.h"
 
-const int g_chunk_size = 16 * 1024;
+/* 默认配置 */
+const int g_chunk_size = 16 * 1024;			// 必须为2的幂，chunk 按此大小对齐
 const int g_max_block_size = 640;
 const int g_block_sizes = 14;
+
+const int g_chunk_header_size = 64;
+const int g_max_size_classes = 32;			// 可配置的规格数量上限
 const int g_chunk_array_increment = 128;
+const size_t g_arena_size = 1024 * 1024;	// 每次映射的内存，切分为多个 chunk
+const int g_thread_cache_batch = 32;		// 线程缓存每次从中心池取出或归还的块数
+
+/* VS2013 不支持 thread_local，只能用 __declspec(thread)，线程退出时不会自动归还缓存 */
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#	define SOA_THREAD_LOCAL __declspec(thread)
+#	define SOA_THREAD_EXIT_RELEASE 0
+#else
+#	define SOA_THREAD_LOCAL thread_local
+#	define SOA_THREAD_EXIT_RELEASE 1
+#endif
+
+/* arena 使用的页面 */
+enum ArenaPages
+{
+	PAGES_NORMAL,
+	PAGES_TRANSPARENT_HUGE,		// 普通映射后建议内核使用透明大页（Linux）
+	PAGES_HUGE,					// 显式大页（Linux MAP_HUGETLB，Windows MEM_LARGE_PAGES），申请失败时退回普通页
+};
+
+/* 分配器配置，构造 BlockAllocator 时确定 */
+struct BlockAllocatorConfig
+{
+	int					chunk_size;		// 2的幂，chunk 按此大小对齐
+	std::vector<int>	block_sizes;	// 递增的块大小，均为16的倍数，不超过 chunk_size - g_chunk_header_size
+	size_t				arena_size;		// 每次向系统映射的内存，切分为多个 chunk；为0时每个 chunk 从 C 运行库单独申请
+	ArenaPages			pages;
+
+	/* 默认配置: 16KB chunk，14种规格，1MB arena */
+	BlockAllocatorConfig();
+};
+
+/* 分配器统计，定义 BLOCK_ALLOCATOR_STATS 时才累计分配次数与峰值，其余项由 GetStats 遍历得到 */
+struct AllocatorStats
+{
+	struct SizeClass
+	{
+		int			block_size;
+		int			chunks;				// 占用的 chunk 数量
+		int			empty_chunks;		// 所有块都空闲的 chunk
+		int			full_chunks;		// 没有空闲块的 chunk
+		long long	free_blocks;		// 空闲链表中的块
+		long long	live_blocks;		// 已分配的块，SOA 中包括线程缓存持有的块
+		long long	peak_live_blocks;	// 已分配块数的峰值
+		long long	allocations;		// 分配次数
+		long long	frees;				// 释放次数
+	};
+
+	bool		enabled;				// 是否开启了计数
+	int			chunk_size;
+	int			chunks;
+	int			arenas;
+	long long	arena_bytes;			// arena 映射的总字节数
+	long long	large_allocations;		// 超过最大块转交 malloc 的次数
+	long long	large_frees;
+	long long	large_bytes;			// 转交 malloc 且尚未释放的字节数
+	int			class_count;
+	SizeClass	classes[g_max_size_classes];
+
+	/* 输出为文本表格 */
+	void Dump(FILE *out) const;
+};
 
 /// This is a small object allocator used for allocating small
 /// objects that persist for more than one time step.
@@ -15,6 +85,7 @@ class BlockAllocator : public NonCopyable
 {
 public:
 	BlockAllocator();
+	explicit BlockAllocator(const BlockAllocatorConfig &config);
 	~BlockAllocator();
 
 public:
@@ -22,17 +93,111 @@ public:
 	void Free(void *p, int size);
 	void Clear();
 
+	/**
+	 * 回收所有块都空闲的 chunk
+	 * 不使用 arena 时还给 C 运行库，是否交还系统由运行库决定；
+	 * 否则还给所在的 arena 并丢弃其物理页，arena 完全空闲时才解除映射
+	 * @return 回收的 chunk 数量
+	 */
+	int Trim();
+
+	/* 统计快照，遍历所有 chunk，只用于诊断 */
+	void GetStats(AllocatorStats &stats) const;
+
+	const BlockAllocatorConfig& GetConfig() const { return config_; }
+
+	/* 最大的块，更大的请求转交 malloc */
+	int GetMaxBlockSize() const { return max_block_size_; }
+
+	int GetSizeClassCount() const { return class_count_; }
+
+	/* 请求大小对应的规格，size 必须在 (0, GetMaxBlockSize()] 内 */
+	int GetSizeIndex(int size) const { return size_lookup_[(size + 15) >> 4]; }
+
+	int GetBlockSize(int index) const { return block_sizes_[index]; }
+
+private:
+	/* chunk 按 chunk_size 对齐，块所在的 chunk 由地址直接得到 */
+	struct Chunk* GetChunk(void *p) const;
+
+	struct Chunk* NewChunk(int index);
+
+	void DeleteChunk(struct Chunk *chunk);
+
+	/* 从 arena 中取出一个 chunk 的内存，必要时映射新的 arena */
+	void* AllocateFromArena(struct Arena *&arena);
+
+	void ReleaseArena(struct Arena *arena);
+
 private:
+	BlockAllocatorConfig	config_;
+	size_t					chunk_mask_;
+	int						max_block_size_;
+	int						class_count_;
+	int						block_sizes_[g_max_size_classes];
+	std::vector<unsigned char>	size_lookup_;	// 下标为 (size + 15) / 16
+
 	int				num_chunk_count_;
 	int				num_chunk_space_;
-	struct Chunk*	chunks_;
-	struct Block*	free_lists_[g_block_sizes];
-	static int		block_sizes_[g_block_sizes];
-	static char		s_block_size_lookup_[g_max_block_size + 1];
-	static bool		s_block_size_lookup_initialized_;
+	struct Chunk**	chunks_;
+	struct Chunk*	free_chunks_[g_max_size_classes];	// 各规格中有空闲块的 chunk
+	std::vector<struct Arena *>	arenas_;
+	struct Arena*	current_arena_;				// 最近切分 chunk 的 arena
+
+	long long		allocations_[g_max_size_classes];
+	long long		frees_[g_max_size_classes];
+	long long		peak_live_blocks_[g_max_size_classes];
+	long long		large_allocations_;
+	long long		large_frees_;
+	long long		large_bytes_;
 };
 
-class SOA final : public Singleton < SOA >, public BlockAllocator
+/// Small object allocator shared by all threads.
+/// Each thread keeps a free list per size class and refills or flushes it
+/// from the locked central BlockAllocator in batches of g_thread_cache_batch.
+class SOA final : public Singleton < SOA >
 {
-	SINGLETON_DEFAULT(SOA);
+	SINGLETON(SOA);
+
+public:
+	/**
+	 * 设置中心池的配置，必须在第一次调用 GetInstance 之前
+	 */
+	static void SetConfig(const BlockAllocatorConfig &config);
+
+	void* Allocate(int size);
+	void Free(void *p, int size);
+
+	/* 释放全部内存，调用时其他线程不能正在使用 */
+	void Clear();
+
+	/**
+	 * 归还当前线程缓存的块，再回收完全空闲的 chunk，规则与 BlockAllocator::Trim 相同
+	 * 其他线程缓存中的块仍视为已分配
+	 * @return 释放的 chunk 数量
+	 */
+	int Trim();
+
+	/* 将当前线程缓存的块归还中心池，没有 thread_local 的平台需要在线程退出前调用 */
+	void ReleaseThreadCache();
+
+	/**
+	 * 统计快照
+	 * 分配与释放次数按线程计数后汇总，块与 chunk 的数量来自中心池
+	 */
+	void GetStats(AllocatorStats &stats);
+
+	/* 输出统计 */
+	void DumpStats(FILE *out = stdout);
+
+private:
+	struct ThreadCache* GetThreadCache();
+	void Refill(struct ThreadCache *cache, int index);
+	void Flush(struct ThreadCache *cache, int index, int count);
+
+private:
+	std::mutex			mutex_;
+	BlockAllocator		central_;
+	struct ThreadCache*	caches_;		// 所有线程的缓存，用于 Clear 与析构
+	AllocatorStats		retired_;		// 已退出线程的分配计数
 };
\ No newline at end of file
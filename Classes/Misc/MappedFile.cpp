@@ -0,0 +1,149 @@
+﻿#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile()
+	: data_(nullptr)
+	, size_(0)
+	, opened_(false)
+#ifdef _WIN32
+	, file_(INVALID_HANDLE_VALUE)
+	, mapping_(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+void MappedFile::Open(const std::string &filename)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("can't open file: " + filename);
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		throw std::runtime_error("can't get file size: " + filename);
+	}
+
+	file_ = file;
+	opened_ = true;
+	if (size.QuadPart == 0)
+	{
+		return;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (data == nullptr)
+	{
+		if (mapping) CloseHandle(mapping);
+		Close();
+		throw std::runtime_error("can't map file: " + filename);
+	}
+
+	mapping_ = mapping;
+	data_ = data;
+	size_ = static_cast<size_t>(size.QuadPart);
+}
+
+void MappedFile::Close()
+{
+	if (data_)
+	{
+		UnmapViewOfFile(data_);
+	}
+	if (mapping_)
+	{
+		CloseHandle(mapping_);
+	}
+	if (file_ != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+	opened_ = false;
+	file_ = INVALID_HANDLE_VALUE;
+	mapping_ = nullptr;
+}
+
+#else
+
+void MappedFile::Open(const std::string &filename)
+{
+	Close();
+
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw std::runtime_error("can't open file: " + filename);
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		close(fd);
+		throw std::runtime_error("can't get file size: " + filename);
+	}
+
+	opened_ = true;
+	if (info.st_size == 0)
+	{
+		close(fd);
+		return;
+	}
+
+	// 映射建立后即可关闭文件描述符
+	void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		opened_ = false;
+		throw std::runtime_error("can't map file: " + filename);
+	}
+
+#ifdef MADV_SEQUENTIAL
+	madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+#endif
+
+	data_ = data;
+	size_ = static_cast<size_t>(info.st_size);
+}
+
+void MappedFile::Close()
+{
+	if (data_)
+	{
+		munmap(const_cast<void *>(data_), size_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+	opened_ = false;
+}
+
+#endif
@@ -0,0 +1,46 @@
+﻿/**
+ * 只读内存映射文件
+ * POSIX 下使用 mmap，Windows 下使用 CreateFileMapping
+ */
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+#include "NonCopyable.h"
+
+class MappedFile : public NonCopyable
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+public:
+	/**
+	 * 映射文件，已映射的文件会先关闭
+	 * @param filename 文件名
+	 * 打开失败时抛出 std::runtime_error
+	 */
+	void Open(const std::string &filename);
+
+	/**
+	 * 解除映射
+	 */
+	void Close();
+
+	bool IsOpen() const { return opened_; }
+
+	const void* GetData() const { return data_; }
+
+	size_t GetSize() const { return size_; }
+
+private:
+	const void*	data_;
+	size_t		size_;
+	bool		opened_;		// 空文件没有映射，但视为已打开
+#ifdef _WIN32
+	void*		file_;
+	void*		mapping_;
+#endif
+};
@@ -0,0 +1,200 @@
+﻿/**
+ * 基于 SOA 的 STL 分配器与对象池
+ * PoolAllocator 可作为 std::map、std::list 等容器的分配器，节点从小对象分配器中分配
+ * ObjectPool 负责构造与析构，释放的对象留在池中供下次使用
+ */
+
+#pragma once
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <cassert>
+#include <type_traits>
+#include "BlockAllocator.h"
+#include "NonCopyable.h"
+
+/* SOA 的块按16字节对齐 */
+const size_t g_pool_alignment = 16;
+
+template <typename T>
+class PoolAllocator
+{
+	static_assert(std::alignment_of<T>::value <= g_pool_alignment, "over-aligned type");
+
+public:
+	typedef T				value_type;
+	typedef T*				pointer;
+	typedef const T*		const_pointer;
+	typedef T&				reference;
+	typedef const T&		const_reference;
+	typedef size_t			size_type;
+	typedef ptrdiff_t		difference_type;
+
+	template <typename U>
+	struct rebind
+	{
+		typedef PoolAllocator<U> other;
+	};
+
+public:
+	PoolAllocator() throw() {}
+
+	template <typename U>
+	PoolAllocator(const PoolAllocator<U> &) throw() {}
+
+public:
+	pointer allocate(size_type count, const void * = nullptr)
+	{
+		if (count > max_size())
+		{
+			throw std::bad_alloc();
+		}
+		return static_cast<pointer>(SOA::GetInstance()->Allocate(static_cast<int>(count * sizeof(T))));
+	}
+
+	void deallocate(pointer p, size_type count)
+	{
+		SOA::GetInstance()->Free(p, static_cast<int>(count * sizeof(T)));
+	}
+
+	size_type max_size() const throw()
+	{
+		return 0x7fffffff / sizeof(T);
+	}
+
+	pointer address(reference value) const { return &value; }
+
+	const_pointer address(const_reference value) const { return &value; }
+
+	template <typename U, typename... Args>
+	void construct(U *p, Args&&... args)
+	{
+		::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+	}
+
+	template <typename U>
+	void destroy(U *p)
+	{
+		p->~U();
+	}
+};
+
+template <typename T, typename U>
+inline bool operator== (const PoolAllocator<T> &, const PoolAllocator<U> &)
+{
+	return true;
+}
+
+template <typename T, typename U>
+inline bool operator!= (const PoolAllocator<T> &, const PoolAllocator<U> &)
+{
+	return false;
+}
+
+/**
+ * 类型化的对象池，不是线程安全的
+ * 销毁的对象只执行析构，内存留在池中，Shrink 或析构池时才归还 SOA
+ */
+template <typename T>
+class ObjectPool : public NonCopyable
+{
+	static_assert(std::alignment_of<T>::value <= g_pool_alignment, "over-aligned type");
+
+	union Slot
+	{
+		Slot*	next;
+		char	storage[sizeof(T)];
+	};
+
+public:
+	ObjectPool()
+		: free_list_(nullptr)
+		, live_(0)
+		, cached_(0)
+	{
+	}
+
+	~ObjectPool()
+	{
+		assert(live_ == 0);
+		Shrink();
+	}
+
+public:
+	/**
+	 * 分配并构造对象
+	 * @param args 构造函数参数
+	 */
+	template <typename... Args>
+	T* Create(Args&&... args)
+	{
+		Slot *slot = free_list_;
+		if (slot)
+		{
+			free_list_ = slot->next;
+			--cached_;
+		}
+		else
+		{
+			slot = static_cast<Slot *>(SOA::GetInstance()->Allocate(sizeof(Slot)));
+		}
+
+		try
+		{
+			T *object = ::new (static_cast<void *>(slot->storage)) T(std::forward<Args>(args)...);
+			++live_;
+			return object;
+		}
+		catch (...)
+		{
+			slot->next = free_list_;
+			free_list_ = slot;
+			++cached_;
+			throw;
+		}
+	}
+
+	/**
+	 * 析构对象，内存留在池中
+	 */
+	void Destroy(T *object)
+	{
+		if (object == nullptr)
+		{
+			return;
+		}
+
+		object->~T();
+		Slot *slot = reinterpret_cast<Slot *>(object);
+		slot->next = free_list_;
+		free_list_ = slot;
+		++cached_;
+		--live_;
+	}
+
+	/**
+	 * 将池中空闲的内存归还 SOA
+	 */
+	void Shrink()
+	{
+		while (free_list_)
+		{
+			Slot *slot = free_list_;
+			free_list_ = slot->next;
+			SOA::GetInstance()->Free(slot, sizeof(Slot));
+		}
+		cached_ = 0;
+	}
+
+	/* 未销毁的对象数量 */
+	size_t GetLiveCount() const { return live_; }
+
+	/* 池中空闲的对象数量 */
+	size_t GetCachedCount() const { return cached_; }
+
+private:
+	Slot*	free_list_;
+	size_t	live_;
+	size_t	cached_;
+};
@@ -0,0 +1,147 @@
+﻿#include "Random.h"
+
+#include <cassert>
+
+/************************************************************************/
+
+void RandomEngine::Generate(uint32_t *out, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		out[i] = Next();
+	}
+}
+
+uint32_t RandomEngine::Bounded(uint32_t range)
+{
+	assert(range > 0);
+
+	uint64_t m = uint64_t(Next()) * range;
+	uint32_t l = static_cast<uint32_t>(m);
+	if (l < range)
+	{
+		// 拒绝落在余数区间的值，保证无偏
+		const uint32_t threshold = (0u - range) % range;
+		while (l < threshold)
+		{
+			m = uint64_t(Next()) * range;
+			l = static_cast<uint32_t>(m);
+		}
+	}
+	return static_cast<uint32_t>(m >> 32);
+}
+
+void RandomEngine::Bounded(uint32_t *out, size_t count, uint32_t range)
+{
+	assert(range > 0);
+
+	Generate(out, count);
+	const uint32_t threshold = (0u - range) % range;
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint64_t m = uint64_t(out[i]) * range;
+		while (static_cast<uint32_t>(m) < threshold)
+		{
+			m = uint64_t(Next()) * range;
+		}
+		out[i] = static_cast<uint32_t>(m >> 32);
+	}
+}
+
+/************************************************************************/
+
+namespace
+{
+	const uint32_t kPhiloxM0 = 0xD2511F53;
+	const uint32_t kPhiloxM1 = 0xCD9E8D57;
+	const uint32_t kPhiloxW0 = 0x9E3779B9;
+	const uint32_t kPhiloxW1 = 0xBB67AE85;
+	const int kPhiloxRounds = 10;
+
+	inline void MulHiLo(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo)
+	{
+		const uint64_t product = uint64_t(a) * b;
+		hi = static_cast<uint32_t>(product >> 32);
+		lo = static_cast<uint32_t>(product);
+	}
+}
+
+PhiloxEngine::PhiloxEngine(uint64_t seed, uint64_t stream)
+{
+	Seed(seed, stream);
+}
+
+void PhiloxEngine::Seed(uint64_t seed, uint64_t stream)
+{
+	state_.key[0] = static_cast<uint32_t>(seed);
+	state_.key[1] = static_cast<uint32_t>(seed >> 32);
+	state_.counter[0] = 0;
+	state_.counter[1] = 0;
+	state_.counter[2] = static_cast<uint32_t>(stream);
+	state_.counter[3] = static_cast<uint32_t>(stream >> 32);
+	state_.buffer[0] = state_.buffer[1] = state_.buffer[2] = state_.buffer[3] = 0;
+	state_.index = 4;
+}
+
+void PhiloxEngine::Refill(uint32_t *out)
+{
+	uint32_t c0 = state_.counter[0], c1 = state_.counter[1], c2 = state_.counter[2], c3 = state_.counter[3];
+	uint32_t k0 = state_.key[0], k1 = state_.key[1];
+
+	for (int round = 0; round < kPhiloxRounds; ++round)
+	{
+		uint32_t hi0, lo0, hi1, lo1;
+		MulHiLo(kPhiloxM0, c0, hi0, lo0);
+		MulHiLo(kPhiloxM1, c2, hi1, lo1);
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+		k0 += kPhiloxW0;
+		k1 += kPhiloxW1;
+	}
+
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+
+	// 块序号为64位
+	if (++state_.counter[0] == 0)
+	{
+		++state_.counter[1];
+	}
+}
+
+uint32_t PhiloxEngine::Next()
+{
+	if (state_.index >= 4)
+	{
+		Refill(state_.buffer);
+		state_.index = 0;
+	}
+	return state_.buffer[state_.index++];
+}
+
+void PhiloxEngine::Generate(uint32_t *out, size_t count)
+{
+	size_t i = 0;
+
+	// 先用完缓冲区中剩余的数
+	while (i < count && state_.index < 4)
+	{
+		out[i++] = state_.buffer[state_.index++];
+	}
+
+	// 整块直接写入输出
+	while (i + 4 <= count)
+	{
+		Refill(out + i);
+		i += 4;
+	}
+
+	while (i < count)
+	{
+		out[i++] = Next();
+	}
+}
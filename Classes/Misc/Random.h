@@ -0,0 +1,77 @@
+﻿/**
+ * 随机数发生器
+ * 默认实现为 Philox4x32-10 计数器随机数，状态只有几十字节，可显式设置种子与流编号
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* 随机数发生器接口 */
+class RandomEngine
+{
+public:
+	virtual ~RandomEngine() {}
+
+	/**
+	 * 生成一个32位随机数
+	 */
+	virtual uint32_t Next() = 0;
+
+	/**
+	 * 批量生成32位随机数
+	 */
+	virtual void Generate(uint32_t *out, size_t count);
+
+	/**
+	 * 生成 [0, range) 内的无偏整数（Lemire 乘法移位法）
+	 * @param range 范围，必须大于0
+	 */
+	uint32_t Bounded(uint32_t range);
+
+	/**
+	 * 批量生成 [0, range) 内的无偏整数
+	 */
+	void Bounded(uint32_t *out, size_t count, uint32_t range);
+};
+
+/* Philox 状态，可直接按字节复制 */
+struct PhiloxState
+{
+	uint32_t	key[2];			// 种子
+	uint32_t	counter[4];		// 前两个字为块序号，后两个字为流编号
+	uint32_t	buffer[4];		// 当前块的输出
+	uint32_t	index;			// buffer 中下一个可用的位置
+};
+
+class PhiloxEngine final : public RandomEngine
+{
+public:
+	/**
+	 * @param seed 种子
+	 * @param stream 流编号，相同种子不同流的序列互不相关
+	 */
+	explicit PhiloxEngine(uint64_t seed = 0, uint64_t stream = 0);
+
+public:
+	/**
+	 * 重新设置种子与流编号，计数器归零
+	 */
+	void Seed(uint64_t seed, uint64_t stream = 0);
+
+	virtual uint32_t Next() override;
+
+	virtual void Generate(uint32_t *out, size_t count) override;
+
+	const PhiloxState& GetState() const { return state_; }
+
+	void SetState(const PhiloxState &state) { state_ = state; }
+
+private:
+	/* 生成下一块4个随机数并推进计数器 */
+	void Refill(uint32_t *out);
+
+private:
+	PhiloxState state_;
+};
@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include <set>
+#include <mutex>
+#include <atomic>
 
 class SingletonBase
 {
@@ -23,12 +25,14 @@ class SingletonBase
 		}
 
 	public:
-		bool is_cleared_;
+		bool		is_cleared_;
+		std::mutex	mutex_;
 	};
 
 protected:
 	SingletonBase()
 	{
+		std::lock_guard<std::mutex> lock(s_instance_table_.mutex_);
 		s_instance_table_.insert(this);
 	}
 
@@ -36,6 +40,7 @@ protected:
 	{
 		if (!s_instance_table_.is_cleared_)
 		{
+			std::lock_guard<std::mutex> lock(s_instance_table_.mutex_);
 			s_instance_table_.erase(this);
 		}
 	}
@@ -48,20 +53,33 @@ template <typename T>
 class Singleton : public SingletonBase
 {
 public:
+	/**
+	 * 获取实例，多线程同时调用时只会创建一次
+	 * 已创建后只有一次原子读取，不加锁
+	 */
 	static T* GetInstance()
 	{
-		if (s_singleton_ == nullptr)
+		T *instance = s_singleton_.load(std::memory_order_acquire);
+		if (instance == nullptr)
 		{
-			s_singleton_ = new (std::nothrow) T();
+			std::lock_guard<std::mutex> lock(s_mutex_);
+			instance = s_singleton_.load(std::memory_order_relaxed);
+			if (instance == nullptr)
+			{
+				instance = new (std::nothrow) T();
+				s_singleton_.store(instance, std::memory_order_release);
+			}
 		}
-		return s_singleton_;
+		return instance;
 	}
 
 	static void DestroyInstance()
 	{
-		if (s_singleton_)
+		std::lock_guard<std::mutex> lock(s_mutex_);
+		T *instance = s_singleton_.load(std::memory_order_acquire);
+		if (instance)
 		{
-			delete s_singleton_;
+			delete instance;
 		}
 	}
 
@@ -73,14 +91,16 @@ protected:
 
 	virtual ~Singleton()
 	{
-		s_singleton_ = nullptr;
+		s_singleton_.store(nullptr, std::memory_order_release);
 	};
 
 private:
-	static T* s_singleton_;
+	static std::atomic<T*>	s_singleton_;
+	static std::mutex		s_mutex_;
 };
 
-template<typename T> T* Singleton<T>::s_singleton_ = nullptr;
+template<typename T> std::atomic<T*> Singleton<T>::s_singleton_(nullptr);
+template<typename T> std::mutex Singleton<T>::s_mutex_;
 
 #define SINGLETON(_class_)				\
 	private:							\
@@ -0,0 +1,162 @@
+﻿/**
+ * 对局回放
+ * 固定长度的文件头加上变长编码的交换序列，用于校验提交的对局是否合法
+ * 文件头按小端序存储，交换编码为 (格子索引 << 2 | 方向) 的 LEB128 变长整数
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "Types.h"
+#include "Backend.h"
+#include "CascadeLog.h"
+#include "Misc/NonCopyable.h"
+
+/* 回放文件标识 "ELRP" */
+static const uint32_t REPLAY_MAGIC = 0x50524c45;
+
+/* 回放文件版本 */
+static const uint16_t REPLAY_VERSION = 1;
+
+/* 回放文件头 */
+struct ReplayHeader
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint8_t		width;			// 地图列数
+	uint8_t		height;			// 地图行数
+	uint32_t	map_hash;		// HashMapConfig 的结果
+	uint32_t	move_count;		// 交换次数
+	uint64_t	seed;			// 随机种子
+	uint64_t	stream;			// 随机流编号
+	uint64_t	board_hash;		// 结束时 Backend::GetBoardHash 的结果
+	uint32_t	eliminated;		// 消除的精灵总数
+	uint32_t	body_size;		// 交换序列的字节数
+};
+
+static_assert(sizeof(ReplayHeader) == 48, "unexpected replay header layout");
+
+/**
+ * 计算地图配置的哈希值（FNV-1a）
+ */
+uint32_t HashMapConfig(const MapConfig &config);
+
+/* 回放记录 */
+class ReplayWriter
+{
+public:
+	ReplayWriter();
+
+public:
+	/**
+	 * 开始记录，清空之前的数据
+	 * @param config 地图配置
+	 * @param seed/stream 设置地图前 Backend 使用的种子与流编号
+	 */
+	void Begin(const MapConfig &config, uint64_t seed, uint64_t stream);
+
+	/**
+	 * 记录一次成功的交换，参数顺序与 Backend::ResolveSwap 一致
+	 */
+	void AddMove(const MapIndex &from, const MapIndex &to);
+
+	/**
+	 * 写入结束时的棋盘状态
+	 * @param board_hash Backend::GetBoardHash 的结果
+	 * @param eliminated 消除的精灵总数
+	 */
+	void Finish(uint64_t board_hash, unsigned int eliminated);
+
+	/**
+	 * 获取回放数据（文件头 + 交换序列）
+	 */
+	const std::vector<uint8_t>& GetData() const { return data_; }
+
+	/**
+	 * 保存到文件，失败时抛出 std::runtime_error
+	 */
+	void Save(const std::string &filename) const;
+
+private:
+	ReplayHeader			header_;
+	std::vector<uint8_t>	data_;
+};
+
+/* 回放读取，不复制数据 */
+class ReplayReader
+{
+public:
+	ReplayReader();
+
+public:
+	/**
+	 * 打开回放数据
+	 * @return 文件头无效或长度不符时返回false
+	 */
+	bool Open(const void *data, size_t size);
+
+	const ReplayHeader& GetHeader() const { return header_; }
+
+	/**
+	 * 读取下一次交换
+	 * @return 读取完毕或数据损坏时返回false
+	 */
+	bool Next(SwapMove &move);
+
+	/**
+	 * 交换序列是否损坏
+	 */
+	bool IsCorrupted() const { return corrupted_; }
+
+private:
+	ReplayHeader	header_;
+	const uint8_t*	cursor_;
+	const uint8_t*	end_;
+	uint32_t		remaining_;
+	bool			corrupted_;
+};
+
+/* 回放校验，重复使用同一个 Backend 以避免分配 */
+class ReplayVerifier : public NonCopyable
+{
+public:
+	enum Result
+	{
+		VERIFY_OK,
+		BAD_HEADER,				// 文件头无效
+		MAP_MISMATCH,			// 地图不一致
+		CORRUPTED,				// 交换序列损坏或数量不符
+		ILLEGAL_MOVE,			// 存在无法消除的交换
+		UNSTABLE_BOARD,			// 交换后棋盘超过轮数上限仍未稳定
+		BOARD_MISMATCH,			// 结束时棋盘不一致
+		ELIMINATED_MISMATCH,	// 消除数量不一致
+	};
+
+public:
+	ReplayVerifier();
+
+public:
+	/**
+	 * 使用 Backend 重放并校验
+	 * @param config 地图配置
+	 * @param data/size 回放数据
+	 */
+	Result Verify(const MapConfig &config, const void *data, size_t size);
+
+	/**
+	 * 上一次校验执行的交换次数
+	 */
+	unsigned int GetVerifiedMoves() const { return verified_moves_; }
+
+	static const char* GetResultName(Result result);
+
+private:
+	NullBackendDelegate	delegate_;
+	Backend				backend_;
+	CascadeLog			log_;
+	unsigned int		verified_moves_;
+};
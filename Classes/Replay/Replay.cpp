@@ -0,0 +1,291 @@
+﻿#include "Replay.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	const uint32_t kFnvOffset32 = 2166136261u;
+	const uint32_t kFnvPrime32 = 16777619u;
+
+	// 交换方向: 右、下、左、上
+	const int kDirectionRow[4] = { 0, 1, 0, -1 };
+	const int kDirectionCol[4] = { 1, 0, -1, 0 };
+
+	inline uint32_t HashBytes(uint32_t hash, const void *data, size_t size)
+	{
+		const uint8_t *bytes = static_cast<const uint8_t *>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ bytes[i]) * kFnvPrime32;
+		}
+		return hash;
+	}
+
+	inline uint32_t HashInt(uint32_t hash, int value)
+	{
+		uint8_t bytes[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			bytes[i] = static_cast<uint8_t>(static_cast<uint32_t>(value) >> (i * 8));
+		}
+		return HashBytes(hash, bytes, sizeof(bytes));
+	}
+}
+
+// 计算地图配置的哈希值
+uint32_t HashMapConfig(const MapConfig &config)
+{
+	uint32_t hash = kFnvOffset32;
+	hash = HashInt(hash, config.width);
+	hash = HashInt(hash, config.height);
+	hash = HashInt(hash, config.type_quantity);
+	for (size_t idx = 0; idx < config.data.size(); ++idx)
+	{
+		const uint8_t valid = config.data[idx] ? 1 : 0;
+		hash = HashBytes(hash, &valid, 1);
+	}
+	return hash;
+}
+
+/************************************************************************/
+
+ReplayWriter::ReplayWriter()
+{
+	memset(&header_, 0, sizeof(header_));
+}
+
+// 开始记录
+void ReplayWriter::Begin(const MapConfig &config, uint64_t seed, uint64_t stream)
+{
+	if (config.width > MAX_MAP_COLS || config.height > MAX_MAP_ROWS)
+	{
+		throw std::runtime_error("map is too large!");
+	}
+
+	memset(&header_, 0, sizeof(header_));
+	header_.magic = REPLAY_MAGIC;
+	header_.version = REPLAY_VERSION;
+	header_.width = static_cast<uint8_t>(config.width);
+	header_.height = static_cast<uint8_t>(config.height);
+	header_.map_hash = HashMapConfig(config);
+	header_.seed = seed;
+	header_.stream = stream;
+
+	data_.assign(sizeof(ReplayHeader), 0);
+	memcpy(&data_[0], &header_, sizeof(header_));
+}
+
+// 记录交换
+void ReplayWriter::AddMove(const MapIndex &from, const MapIndex &to)
+{
+	if (header_.magic != REPLAY_MAGIC)
+	{
+		throw std::runtime_error("replay is not started!");
+	}
+
+	int direction = 0;
+	while (direction < 4 && (to.row != from.row + kDirectionRow[direction] || to.col != from.col + kDirectionCol[direction]))
+	{
+		++direction;
+	}
+	if (direction == 4 || from.row < 0 || from.row >= header_.height || from.col < 0 || from.col >= header_.width)
+	{
+		throw std::runtime_error("invalid replay move!");
+	}
+
+	// LEB128 变长编码，64x64 以内的地图每步最多两个字节
+	uint32_t value = static_cast<uint32_t>(from.row * header_.width + from.col) << 2 | direction;
+	while (value >= 0x80)
+	{
+		data_.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	data_.push_back(static_cast<uint8_t>(value));
+
+	++header_.move_count;
+}
+
+// 写入结束状态
+void ReplayWriter::Finish(uint64_t board_hash, unsigned int eliminated)
+{
+	header_.board_hash = board_hash;
+	header_.eliminated = eliminated;
+	header_.body_size = static_cast<uint32_t>(data_.size() - sizeof(ReplayHeader));
+	memcpy(&data_[0], &header_, sizeof(header_));
+}
+
+// 保存到文件
+void ReplayWriter::Save(const std::string &filename) const
+{
+	FILE *file = fopen(filename.c_str(), "wb");
+	if (file == nullptr)
+	{
+		throw std::runtime_error("can't open replay file: " + filename);
+	}
+
+	const bool ok = data_.empty() || fwrite(&data_[0], 1, data_.size(), file) == data_.size();
+	fclose(file);
+	if (!ok)
+	{
+		throw std::runtime_error("can't write replay file: " + filename);
+	}
+}
+
+/************************************************************************/
+
+ReplayReader::ReplayReader()
+	: cursor_(nullptr)
+	, end_(nullptr)
+	, remaining_(0)
+	, corrupted_(false)
+{
+	memset(&header_, 0, sizeof(header_));
+}
+
+// 打开回放数据
+bool ReplayReader::Open(const void *data, size_t size)
+{
+	cursor_ = end_ = nullptr;
+	remaining_ = 0;
+	corrupted_ = false;
+
+	if (data == nullptr || size < sizeof(ReplayHeader))
+	{
+		return false;
+	}
+
+	memcpy(&header_, data, sizeof(header_));
+	if (header_.magic != REPLAY_MAGIC || header_.version != REPLAY_VERSION
+		|| header_.width == 0 || header_.height == 0
+		|| header_.width > MAX_MAP_COLS || header_.height > MAX_MAP_ROWS
+		|| size - sizeof(ReplayHeader) != header_.body_size)
+	{
+		return false;
+	}
+
+	cursor_ = static_cast<const uint8_t *>(data) + sizeof(ReplayHeader);
+	end_ = cursor_ + header_.body_size;
+	remaining_ = header_.move_count;
+	return true;
+}
+
+// 读取下一次交换
+bool ReplayReader::Next(SwapMove &move)
+{
+	if (remaining_ == 0)
+	{
+		// 交换数量已读完但仍有剩余数据
+		corrupted_ = corrupted_ || cursor_ != end_;
+		return false;
+	}
+
+	uint32_t value = 0;
+	for (int shift = 0; ; shift += 7)
+	{
+		if (cursor_ == end_ || shift > 28)
+		{
+			corrupted_ = true;
+			return false;
+		}
+		const uint8_t byte = *cursor_++;
+		value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			break;
+		}
+	}
+
+	const uint32_t cell = value >> 2;
+	const int direction = value & 3;
+	if (cell >= static_cast<uint32_t>(header_.width) * header_.height)
+	{
+		corrupted_ = true;
+		return false;
+	}
+
+	move.from.row = cell / header_.width;
+	move.from.col = cell % header_.width;
+	move.to.row = move.from.row + kDirectionRow[direction];
+	move.to.col = move.from.col + kDirectionCol[direction];
+	--remaining_;
+	return true;
+}
+
+/************************************************************************/
+
+ReplayVerifier::ReplayVerifier()
+	: backend_(&delegate_)
+	, log_(4096)
+	, verified_moves_(0)
+{
+}
+
+// 重放并校验
+ReplayVerifier::Result ReplayVerifier::Verify(const MapConfig &config, const void *data, size_t size)
+{
+	verified_moves_ = 0;
+
+	ReplayReader reader;
+	if (!reader.Open(data, size))
+	{
+		return BAD_HEADER;
+	}
+
+	const ReplayHeader &header = reader.GetHeader();
+	if (header.width != config.width || header.height != config.height || header.map_hash != HashMapConfig(config))
+	{
+		return MAP_MISMATCH;
+	}
+
+	backend_.SetSeed(header.seed, header.stream);
+	backend_.SetMap(config);
+
+	SwapMove move;
+	unsigned int eliminated = 0;
+	while (reader.Next(move))
+	{
+		const Backend::ResolveResult result = backend_.ResolveSwap(move.from, move.to, log_);
+		if (result == Backend::RESOLVE_INVALID)
+		{
+			return ILLEGAL_MOVE;
+		}
+		if (result == Backend::RESOLVE_UNSTABLE)
+		{
+			return UNSTABLE_BOARD;
+		}
+		eliminated += log_.GetEliminated();
+		++verified_moves_;
+	}
+
+	if (reader.IsCorrupted() || verified_moves_ != header.move_count)
+	{
+		return CORRUPTED;
+	}
+	if (backend_.GetBoardHash() != header.board_hash)
+	{
+		return BOARD_MISMATCH;
+	}
+	if (eliminated != header.eliminated)
+	{
+		return ELIMINATED_MISMATCH;
+	}
+	return VERIFY_OK;
+}
+
+const char* ReplayVerifier::GetResultName(Result result)
+{
+	switch (result)
+	{
+	case VERIFY_OK:				return "ok";
+	case BAD_HEADER:			return "bad header";
+	case MAP_MISMATCH:			return "map mismatch";
+	case CORRUPTED:				return "corrupted";
+	case ILLEGAL_MOVE:			return "illegal move";
+	case UNSTABLE_BOARD:		return "unstable board";
+	case BOARD_MISMATCH:		return "board mismatch";
+	case ELIMINATED_MISMATCH:	return "eliminated mismatch";
+	}
+	return "unknown";
+}
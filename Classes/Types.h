@@ -11,6 +11,10 @@
 /* 无效索引 */
 static const int INVALID_INDEX = -1;
 
+/* 地图最大行列数 */
+static const int MAX_MAP_ROWS = 64;
+static const int MAX_MAP_COLS = 64;
+
 /* 地图配置 */
 struct MapConfig
 {
@@ -49,4 +53,15 @@ struct MapIndex
 	{
 		return this->row < that.row ? true : this->row == that.row ? this->col < that.col : false;
 	}
+};
+
+/* 交换操作 */
+struct SwapMove
+{
+	MapIndex			from;
+	MapIndex			to;
+
+	SwapMove() {}
+
+	SwapMove(const MapIndex &from, const MapIndex &to) : from(from), to(to) {}
 };
\ No newline at end of file
@@ -0,0 +1,360 @@
+﻿/**
+ * 小对象分配器基准
+ * 比较 SOA 与系统 malloc 的单次分配延迟与多线程吞吐，以及容器分别使用 std::allocator 与 PoolAllocator 的耗时，最后输出 SOA 的统计
+ * 以 -DALLOCATOR_STATS=ON 构建时统计中包括分配次数与峰值
+ *
+ * 用法: eliminate_allocbench [--threads 线程数] [--ops 次数] [--live 数量] [--min 字节] [--max 字节] [--seed 种子]
+ *                             [--chunk 字节] [--arena 字节] [--huge transparent|explicit]
+ * --chunk / --arena / --huge 设置 SOA 的 chunk 大小、arena 大小与大页方式
+ */
+
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <map>
+#include <list>
+#include <stdexcept>
+
+#include "Types.h"
+#include "Misc/BlockAllocator.h"
+#include "Misc/PoolAllocator.h"
+
+namespace
+{
+	/* 命令行参数 */
+	struct Options
+	{
+		int				threads;
+		int				ops;			// 每个线程的操作次数
+		int				live;			// 吞吐测试中每个线程持有的块数
+		int				min_size;
+		int				max_size;
+		unsigned int	seed;
+		BlockAllocatorConfig config;	// SOA 配置
+
+		Options() : threads(0), ops(2000000), live(4096), min_size(8), max_size(256), seed(5489u) {}
+	};
+
+	struct SystemAllocator
+	{
+		static const char* Name() { return "malloc"; }
+		static void* Allocate(int size) { return malloc(size); }
+		static void Free(void *p, int) { free(p); }
+	};
+
+	struct SmallObjectAllocator
+	{
+		static const char* Name() { return "SOA"; }
+		static void* Allocate(int size) { return SOA::GetInstance()->Allocate(size); }
+		static void Free(void *p, int size) { SOA::GetInstance()->Free(p, size); }
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	double Seconds(const Clock::time_point &start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	/* 每次分配后立即释放，测量一次分配与释放的延迟 */
+	template <typename Allocator>
+	double PairLatency(int size, int ops)
+	{
+		const auto start = Clock::now();
+		for (int i = 0; i < ops; ++i)
+		{
+			char *p = static_cast<char *>(Allocator::Allocate(size));
+			*static_cast<volatile char *>(p) = static_cast<char>(i);
+			Allocator::Free(p, size);
+		}
+		return Seconds(start) * 1e9 / ops;
+	}
+
+	/* 连续分配一批再全部释放，会触发线程缓存的补充与归还 */
+	template <typename Allocator>
+	double BatchLatency(int size, int ops)
+	{
+		const int kBatch = 1024;
+		std::vector<void *> blocks(kBatch);
+		const int rounds = std::max(1, ops / kBatch);
+		const auto start = Clock::now();
+		for (int round = 0; round < rounds; ++round)
+		{
+			for (int i = 0; i < kBatch; ++i)
+			{
+				blocks[i] = Allocator::Allocate(size);
+				*static_cast<volatile char *>(blocks[i]) = static_cast<char>(i);
+			}
+			for (int i = 0; i < kBatch; ++i)
+			{
+				Allocator::Free(blocks[i], size);
+			}
+		}
+		return Seconds(start) * 1e9 / (double(rounds) * kBatch);
+	}
+
+	/* 每个线程持有固定数量的块，随机替换其中一块 */
+	template <typename Allocator>
+	void ChurnWorker(const Options &options, unsigned int seed)
+	{
+		std::mt19937 generator(seed);
+		std::uniform_int_distribution<int> size_dis(options.min_size, options.max_size);
+		std::uniform_int_distribution<int> slot_dis(0, options.live - 1);
+
+		// 预先生成随机序列，不计入分配时间之外的开销
+		std::vector<std::pair<int, int>> sequence(65536);
+		for (auto &step : sequence)
+		{
+			step = std::make_pair(slot_dis(generator), size_dis(generator));
+		}
+
+		std::vector<void *> blocks(options.live, nullptr);
+		std::vector<int> sizes(options.live, 0);
+		for (int i = 0; i < options.ops; ++i)
+		{
+			const std::pair<int, int> &step = sequence[i & 0xffff];
+			if (blocks[step.first])
+			{
+				Allocator::Free(blocks[step.first], sizes[step.first]);
+			}
+			blocks[step.first] = Allocator::Allocate(step.second);
+			sizes[step.first] = step.second;
+			*static_cast<volatile char *>(blocks[step.first]) = static_cast<char>(i);
+		}
+
+		for (int i = 0; i < options.live; ++i)
+		{
+			if (blocks[i]) Allocator::Free(blocks[i], sizes[i]);
+		}
+	}
+
+	/* 多线程吞吐，返回每秒操作数 */
+	template <typename Allocator>
+	double Throughput(const Options &options, int threads)
+	{
+		std::vector<std::thread> workers;
+		const auto start = Clock::now();
+		for (int i = 0; i < threads; ++i)
+		{
+			workers.push_back(std::thread(ChurnWorker<Allocator>, std::cref(options), options.seed + i));
+		}
+		for (auto &worker : workers)
+		{
+			worker.join();
+		}
+		return double(options.ops) * threads / Seconds(start);
+	}
+
+	/* 在 64x64 的格子上随机插入与删除，与 GameLayer::used_elments 的用法相同 */
+	template <typename Map>
+	double MapChurn(int ops, unsigned int seed)
+	{
+		std::mt19937 generator(seed);
+		Map map;
+		const auto start = Clock::now();
+		for (int i = 0; i < ops; ++i)
+		{
+			const unsigned int value = generator();
+			const MapIndex index(value & 63, (value >> 6) & 63);
+			if (value & (1u << 12))
+			{
+				map[index] = &map;
+			}
+			else
+			{
+				map.erase(index);
+			}
+		}
+		return Seconds(start) * 1e9 / ops;
+	}
+
+	/* 队列式的插入与删除 */
+	template <typename List>
+	double ListChurn(int ops)
+	{
+		List list;
+		const auto start = Clock::now();
+		for (int i = 0; i < ops; ++i)
+		{
+			list.push_back(i);
+			if (list.size() > 256)
+			{
+				list.pop_front();
+			}
+		}
+		return Seconds(start) * 1e9 / ops;
+	}
+
+	/* 每步临时创建的对象 */
+	struct ScratchObject
+	{
+		MapIndex	from;
+		MapIndex	to;
+		int			value[8];
+
+		ScratchObject(int seed) : from(seed, seed), to(seed, seed + 1)
+		{
+			value[0] = seed;
+		}
+	};
+
+	double NewDeleteChurn(int ops)
+	{
+		std::vector<ScratchObject *> objects(64, nullptr);
+		const auto start = Clock::now();
+		for (int i = 0; i < ops; ++i)
+		{
+			ScratchObject *&slot = objects[i & 63];
+			delete slot;
+			slot = new ScratchObject(i);
+		}
+		for (auto object : objects) delete object;
+		return Seconds(start) * 1e9 / ops;
+	}
+
+	double ObjectPoolChurn(int ops)
+	{
+		ObjectPool<ScratchObject> pool;
+		std::vector<ScratchObject *> objects(64, nullptr);
+		const auto start = Clock::now();
+		for (int i = 0; i < ops; ++i)
+		{
+			ScratchObject *&slot = objects[i & 63];
+			pool.Destroy(slot);
+			slot = pool.Create(i);
+		}
+		for (auto object : objects) pool.Destroy(object);
+		return Seconds(start) * 1e9 / ops;
+	}
+
+	void PrintUsage()
+	{
+		printf("usage: eliminate_allocbench [--threads n] [--ops n] [--live n] [--min bytes] [--max bytes] [--seed n]\n"
+			"                            [--chunk bytes] [--arena bytes] [--huge transparent|explicit]\n");
+	}
+
+	bool ParseOptions(int argc, char *argv[], Options &options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char *arg = argv[i];
+			const bool has_value = i + 1 < argc;
+			if (strcmp(arg, "--threads") == 0 && has_value)
+			{
+				options.threads = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--ops") == 0 && has_value)
+			{
+				options.ops = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--live") == 0 && has_value)
+			{
+				options.live = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--min") == 0 && has_value)
+			{
+				options.min_size = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--max") == 0 && has_value)
+			{
+				options.max_size = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--seed") == 0 && has_value)
+			{
+				options.seed = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+			}
+			else if (strcmp(arg, "--chunk") == 0 && has_value)
+			{
+				options.config.chunk_size = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--arena") == 0 && has_value)
+			{
+				options.config.arena_size = static_cast<size_t>(strtoull(argv[++i], nullptr, 10));
+			}
+			else if (strcmp(arg, "--huge") == 0 && has_value)
+			{
+				const char *value = argv[++i];
+				if (strcmp(value, "transparent") == 0) options.config.pages = PAGES_TRANSPARENT_HUGE;
+				else if (strcmp(value, "explicit") == 0) options.config.pages = PAGES_HUGE;
+				else return false;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return options.ops > 0 && options.live > 0 && options.min_size > 0 && options.max_size >= options.min_size;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (options.threads <= 0)
+	{
+		options.threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	try
+	{
+		SOA::SetConfig(options.config);
+		printf("chunk %d bytes, arena %llu bytes\n\n", options.config.chunk_size, (unsigned long long)options.config.arena_size);
+
+		printf("latency (ns per allocate + free, single thread)\n");
+		printf("size      malloc pair   SOA pair  malloc batch  SOA batch\n");
+		const int sizes[] = { 16, 64, 128, 256, 640, 1024 };
+		for (int size : sizes)
+		{
+			printf("%4d  %14.1f  %9.1f  %12.1f  %9.1f\n", size,
+				PairLatency<SystemAllocator>(size, options.ops),
+				PairLatency<SmallObjectAllocator>(size, options.ops),
+				BatchLatency<SystemAllocator>(size, options.ops),
+				BatchLatency<SmallObjectAllocator>(size, options.ops));
+		}
+
+		typedef std::pair<const MapIndex, void *> MapValue;
+		typedef std::map<MapIndex, void *> SystemMap;
+		typedef std::map<MapIndex, void *, std::less<MapIndex>, PoolAllocator<MapValue>> PoolMap;
+		printf("\ncontainers (ns per operation, single thread)\n");
+		printf("container          std::allocator  PoolAllocator\n");
+		printf("std::map           %14.1f  %13.1f\n",
+			MapChurn<SystemMap>(options.ops, options.seed), MapChurn<PoolMap>(options.ops, options.seed));
+		printf("std::list          %14.1f  %13.1f\n",
+			ListChurn<std::list<int>>(options.ops), ListChurn<std::list<int, PoolAllocator<int>>>(options.ops));
+		printf("new / ObjectPool   %14.1f  %13.1f\n", NewDeleteChurn(options.ops), ObjectPoolChurn(options.ops));
+
+		printf("\nthroughput (Mops/s, %d live blocks of %d-%d bytes per thread)\n", options.live, options.min_size, options.max_size);
+		printf("threads      malloc        SOA\n");
+		for (int threads = 1; ; threads = std::min(threads * 2, options.threads))
+		{
+			const double system = Throughput<SystemAllocator>(options, threads);
+			const double pool = Throughput<SmallObjectAllocator>(options, threads);
+			printf("%7d  %10.2f  %9.2f\n", threads, system / 1e6, pool / 1e6);
+			if (threads >= options.threads)
+			{
+				break;
+			}
+		}
+
+		printf("\nSOA statistics\n");
+		SOA::GetInstance()->DumpStats(stdout);
+	}
+	catch (const std::exception &e)
+	{
+		fprintf(stderr, "error: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
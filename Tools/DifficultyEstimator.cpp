@@ -0,0 +1,546 @@
+﻿/**
+ * 关卡难度估计
+ * 多线程蒙特卡洛对局，统计达到目标消除数的步数、平均连锁层数与死局率
+ * 每个关卡的对局按批次分配到各线程的任务队列，空闲线程从其他队列尾部窃取任务，置信区间足够窄时提前结束
+ *
+ * 用法: eliminate_difficulty [--types 数量] [--threads 线程数] [--policy random|greedy] [--target 消除数]
+ *                           [--max-moves 步数] [--min-games 局数] [--max-games 局数] [--precision 相对误差]
+ *                           [--rate-precision 绝对误差] [--seed 种子] 地图文件...
+ */
+
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+
+#include "Backend.h"
+#include "MapMask.h"
+
+namespace
+{
+	/* 95% 置信区间的正态分位数 */
+	const double kZ95 = 1.96;
+
+	/* 每个任务包含的对局数 */
+	const int kBatchGames = 16;
+
+	/* 命令行参数 */
+	struct Options
+	{
+		std::vector<std::string>	map_files;
+		int							types;
+		int							threads;
+		bool						greedy;			// 贪心策略，否则随机选择
+		int							target;			// 目标消除数
+		int							max_moves;		// 每局最大步数
+		int							min_games;		// 提前结束前至少进行的局数
+		int							max_games;		// 每个关卡最多进行的局数
+		double						precision;		// 均值置信区间半宽与均值之比
+		double						rate_precision;	// 比例置信区间半宽
+		uint64_t					seed;
+
+		Options()
+			: types(0)
+			, threads(0)
+			, greedy(false)
+			, target(100)
+			, max_moves(200)
+			, min_games(200)
+			, max_games(20000)
+			, precision(0.02)
+			, rate_precision(0.01)
+			, seed(5489u)
+		{
+		}
+	};
+
+	/* 样本累计，用于计算均值与置信区间 */
+	struct Accumulator
+	{
+		double	count;
+		double	sum;
+		double	sum2;
+
+		Accumulator() : count(0), sum(0), sum2(0) {}
+
+		void Add(double value)
+		{
+			count += 1;
+			sum += value;
+			sum2 += value * value;
+		}
+
+		void Merge(const Accumulator &that)
+		{
+			count += that.count;
+			sum += that.sum;
+			sum2 += that.sum2;
+		}
+
+		double Mean() const
+		{
+			return count > 0 ? sum / count : 0.0;
+		}
+
+		/* 均值 95% 置信区间半宽 */
+		double HalfWidth() const
+		{
+			if (count < 2)
+			{
+				return HUGE_VAL;
+			}
+			const double mean = Mean();
+			const double variance = (sum2 - count * mean * mean) / (count - 1);
+			return kZ95 * sqrt(variance > 0 ? variance / count : 0.0);
+		}
+	};
+
+	/* 关卡统计 */
+	struct LevelStats
+	{
+		Accumulator		moves_to_target;	// 达到目标的局的步数
+		Accumulator		cascade_depth;		// 每步的连锁层数
+		Accumulator		dead;				// 是否死局，取值0或1
+		Accumulator		reached;			// 是否达到目标，取值0或1
+
+		void Merge(const LevelStats &that)
+		{
+			moves_to_target.Merge(that.moves_to_target);
+			cascade_depth.Merge(that.cascade_depth);
+			dead.Merge(that.dead);
+			reached.Merge(that.reached);
+		}
+	};
+
+	/* 关卡 */
+	struct Level
+	{
+		std::string			name;
+		MapConfig			config;
+		std::mutex			mutex;
+		LevelStats			stats;
+		std::atomic<bool>	finished;		// 置信区间已足够窄
+
+		Level() : finished(false) {}
+	};
+
+	/* 任务: 某个关卡的一批对局 */
+	struct Task
+	{
+		int		level;
+		int		first_game;
+	};
+
+	/* 线程的任务队列，所有者从头部取，窃取者从尾部取 */
+	struct WorkQueue
+	{
+		std::mutex			mutex;
+		std::deque<Task>	tasks;
+
+		bool PopFront(Task &task)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (tasks.empty())
+			{
+				return false;
+			}
+			task = tasks.front();
+			tasks.pop_front();
+			return true;
+		}
+
+		bool PopBack(Task &task)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (tasks.empty())
+			{
+				return false;
+			}
+			task = tasks.back();
+			tasks.pop_back();
+			return true;
+		}
+	};
+
+	/* 工作线程的私有状态 */
+	class Worker
+	{
+	public:
+		Worker(const Options &options)
+			: options_(options)
+			, backend_(&delegate_)
+		{
+			candidates_.reserve(256);
+		}
+
+	public:
+		/**
+		 * 进行一批对局
+		 */
+		void RunBatch(Level &level, int level_index, int first_game, LevelStats &out)
+		{
+			for (int game = first_game; game < first_game + kBatchGames && game < options_.max_games; ++game)
+			{
+				PlayGame(level.config, (uint64_t(level_index) << 32) | uint32_t(game), out);
+			}
+		}
+
+	private:
+		void PlayGame(const MapConfig &config, uint64_t stream, LevelStats &out)
+		{
+			backend_.SetSeed(options_.seed, stream);
+			backend_.SetMap(config);
+			policy_.Seed(~options_.seed, stream);
+
+			int moves = 0;
+			unsigned int eliminated = 0;
+			bool dead = false;
+			while (eliminated < static_cast<unsigned int>(options_.target) && moves < options_.max_moves)
+			{
+				if (backend_.GenerateMoves(candidates_) == 0)
+				{
+					dead = true;
+					break;
+				}
+
+				const SwapMove &move = options_.greedy ? GreedyMove() : candidates_[policy_.Bounded(static_cast<uint32_t>(candidates_.size()))];
+				const Backend::ResolveResult result = backend_.ResolveSwap(move.from, move.to, log_);
+				if (result == Backend::RESOLVE_INVALID)
+				{
+					throw std::runtime_error("generated move can't eliminate!");
+				}
+				if (result == Backend::RESOLVE_UNSTABLE)
+				{
+					throw std::runtime_error("board never settles!");
+				}
+
+				++moves;
+				eliminated += log_.GetEliminated();
+				out.cascade_depth.Add(log_.GetMaxDepth());
+			}
+
+			const bool reached = eliminated >= static_cast<unsigned int>(options_.target);
+			if (reached)
+			{
+				out.moves_to_target.Add(moves);
+			}
+			out.reached.Add(reached ? 1 : 0);
+			out.dead.Add(dead ? 1 : 0);
+		}
+
+		/* 选择直接消除数量最多的交换，数量相同时随机选择 */
+		const SwapMove& GreedyMove()
+		{
+			size_t best = 0;
+			size_t best_size = 0;
+			unsigned int ties = 0;
+			for (size_t i = 0; i < candidates_.size(); ++i)
+			{
+				const SwapMove &move = candidates_[i];
+				backend_.SwapSprite(move.from, move.to);
+				eliminate_set_.clear();
+				backend_.IsCanEliminate(move.to, move.from, eliminate_set_);
+				backend_.SwapSprite(move.from, move.to);
+
+				const size_t size = eliminate_set_.size();
+				if (size > best_size)
+				{
+					best = i;
+					best_size = size;
+					ties = 1;
+				}
+				else if (size == best_size && policy_.Bounded(++ties) == 0)
+				{
+					best = i;
+				}
+			}
+			return candidates_[best];
+		}
+
+	private:
+		const Options&			options_;
+		NullBackendDelegate		delegate_;
+		Backend					backend_;
+		PhiloxEngine			policy_;
+		CascadeLog				log_;
+		CellSet					eliminate_set_;
+		std::vector<SwapMove>	candidates_;
+	};
+
+	/* 工作线程的第一个异常，出现后其余线程停止取任务 */
+	struct WorkerError
+	{
+		std::mutex			mutex;
+		std::exception_ptr	error;
+		std::atomic<bool>	stopped;
+
+		WorkerError() : stopped(false) {}
+
+		void Set(std::exception_ptr e)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+			{
+				error = e;
+			}
+			stopped.store(true);
+		}
+	};
+
+	/* 置信区间是否足够窄 */
+	bool IsPrecise(const LevelStats &stats, const Options &options)
+	{
+		if (stats.reached.count < options.min_games)
+		{
+			return false;
+		}
+
+		const double rate_precision = options.rate_precision;
+		if (stats.dead.HalfWidth() > rate_precision || stats.reached.HalfWidth() > rate_precision)
+		{
+			return false;
+		}
+
+		const Accumulator &moves = stats.moves_to_target;
+		const Accumulator &depth = stats.cascade_depth;
+		return (moves.count == 0 || moves.HalfWidth() <= options.precision * moves.Mean())
+			&& (depth.count == 0 || depth.HalfWidth() <= options.precision * depth.Mean() || depth.HalfWidth() <= rate_precision);
+	}
+
+	/* 处理任务直到队列为空或其他线程出错 */
+	void RunWorker(int index, const Options &options, std::vector<Level> &levels, std::vector<WorkQueue> &queues, WorkerError &error)
+	{
+		Worker worker(options);
+		const int count = static_cast<int>(queues.size());
+
+		while (!error.stopped.load())
+		{
+			Task task;
+			bool found = queues[index].PopFront(task);
+			for (int i = 1; !found && i < count; ++i)
+			{
+				found = queues[(index + i) % count].PopBack(task);
+			}
+			if (!found)
+			{
+				break;
+			}
+
+			Level &level = levels[task.level];
+			if (level.finished.load(std::memory_order_relaxed))
+			{
+				continue;
+			}
+
+			LevelStats batch;
+			worker.RunBatch(level, task.level, task.first_game, batch);
+
+			std::lock_guard<std::mutex> lock(level.mutex);
+			level.stats.Merge(batch);
+			if (IsPrecise(level.stats, options))
+			{
+				level.finished.store(true, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/* 工作线程 */
+	void WorkerThread(int index, const Options &options, std::vector<Level> &levels, std::vector<WorkQueue> &queues, WorkerError &error)
+	{
+		// 异常离开线程函数会调用 std::terminate，记录后交给主线程报告
+		try
+		{
+			RunWorker(index, options, levels, queues, error);
+		}
+		catch (...)
+		{
+			error.Set(std::current_exception());
+		}
+	}
+
+	void PrintUsage()
+	{
+		printf("usage: eliminate_difficulty [--types n] [--threads n] [--policy random|greedy] [--target n] [--max-moves n]\n"
+			   "                            [--min-games n] [--max-games n] [--precision x] [--rate-precision x] [--seed n] map...\n");
+	}
+
+	bool ParseOptions(int argc, char *argv[], Options &options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char *arg = argv[i];
+			const bool has_value = i + 1 < argc;
+			if (strcmp(arg, "--types") == 0 && has_value)
+			{
+				options.types = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--threads") == 0 && has_value)
+			{
+				options.threads = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--policy") == 0 && has_value)
+			{
+				const char *policy = argv[++i];
+				if (strcmp(policy, "greedy") == 0)
+				{
+					options.greedy = true;
+				}
+				else if (strcmp(policy, "random") != 0)
+				{
+					return false;
+				}
+			}
+			else if (strcmp(arg, "--target") == 0 && has_value)
+			{
+				options.target = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--max-moves") == 0 && has_value)
+			{
+				options.max_moves = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--min-games") == 0 && has_value)
+			{
+				options.min_games = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--max-games") == 0 && has_value)
+			{
+				options.max_games = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--precision") == 0 && has_value)
+			{
+				options.precision = atof(argv[++i]);
+			}
+			else if (strcmp(arg, "--rate-precision") == 0 && has_value)
+			{
+				options.rate_precision = atof(argv[++i]);
+			}
+			else if (strcmp(arg, "--seed") == 0 && has_value)
+			{
+				options.seed = strtoull(argv[++i], nullptr, 10);
+			}
+			else if (arg[0] == '-')
+			{
+				return false;
+			}
+			else
+			{
+				options.map_files.push_back(arg);
+			}
+		}
+		return options.target > 0 && options.max_moves > 0 && options.max_games > 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	try
+	{
+		if (options.map_files.empty())
+		{
+			options.map_files.push_back(std::string());
+		}
+
+		std::vector<Level> levels(options.map_files.size());
+		for (size_t i = 0; i < levels.size(); ++i)
+		{
+			levels[i].name = options.map_files[i].empty() ? "<default>" : options.map_files[i];
+			levels[i].config = tools::LoadMask(options.map_files[i]);
+			if (options.types > 0)
+			{
+				levels[i].config.type_quantity = options.types;
+			}
+		}
+
+		int threads = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+		if (threads <= 0)
+		{
+			threads = 1;
+		}
+
+		// 按关卡顺序轮流分配任务，各线程大致同时处理同一关卡，便于提前结束
+		std::vector<WorkQueue> queues(threads);
+		int next_queue = 0;
+		for (size_t level = 0; level < levels.size(); ++level)
+		{
+			for (int game = 0; game < options.max_games; game += kBatchGames)
+			{
+				Task task;
+				task.level = static_cast<int>(level);
+				task.first_game = game;
+				queues[next_queue].tasks.push_back(task);
+				next_queue = (next_queue + 1) % threads;
+			}
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		WorkerError error;
+		std::vector<std::thread> workers;
+		for (int i = 1; i < threads; ++i)
+		{
+			workers.push_back(std::thread(WorkerThread, i, std::cref(options), std::ref(levels), std::ref(queues), std::ref(error)));
+		}
+		WorkerThread(0, options, levels, queues, error);
+		for (auto &worker : workers)
+		{
+			worker.join();
+		}
+		if (error.error)
+		{
+			std::rethrow_exception(error.error);
+		}
+		const auto finish = std::chrono::steady_clock::now();
+
+		printf("policy: %s, target: %d eliminated, max moves: %d, threads: %d\n",
+			options.greedy ? "greedy" : "random", options.target, options.max_moves, threads);
+		printf("%-24s %7s %18s %8s %16s %16s\n", "level", "games", "moves to target", "reached", "cascade depth", "dead rate");
+
+		for (auto &level : levels)
+		{
+			const LevelStats &stats = level.stats;
+			char moves[32];
+			if (stats.moves_to_target.count > 0)
+			{
+				snprintf(moves, sizeof(moves), "%.2f +- %.2f", stats.moves_to_target.Mean(), stats.moves_to_target.HalfWidth());
+			}
+			else
+			{
+				snprintf(moves, sizeof(moves), "-");
+			}
+
+			char depth[32];
+			snprintf(depth, sizeof(depth), "%.3f +- %.3f", stats.cascade_depth.Mean(),
+				stats.cascade_depth.count > 1 ? stats.cascade_depth.HalfWidth() : 0.0);
+
+			char dead[32];
+			snprintf(dead, sizeof(dead), "%.3f +- %.3f", stats.dead.Mean(), stats.dead.count > 1 ? stats.dead.HalfWidth() : 0.0);
+
+			printf("%-24s %7.0f %18s %7.1f%% %16s %16s%s\n", level.name.c_str(), stats.reached.count, moves,
+				stats.reached.Mean() * 100.0, depth, dead, level.finished ? "" : " (max games)");
+		}
+
+		printf("elapsed: %.3f s\n", std::chrono::duration<double>(finish - start).count());
+	}
+	catch (const std::exception &e)
+	{
+		fprintf(stderr, "error: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,426 @@
+﻿/**
+ * 关卡转换
+ * 将 Tiled 地图（.tmx）或文本掩码转换为二进制关卡，并可将 config.json 转换为二进制游戏配置
+ * 游戏加载关卡时不再需要解析 XML、base64 解码与 zlib 解压
+ *
+ * 用法: eliminate_levelconv [--config config.json] [--config-out 文件] [地图 关卡文件]
+ *       eliminate_levelconv [--config config.json] --pack 关卡包 地图...
+ * 指定 --config 时关卡的类型数量不超过配置中的 TypeQuantity，与 Config::ReadMapConfig 一致
+ * --pack 按参数顺序将多个地图合并为关卡包
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "Level.h"
+#include "LevelPack.h"
+#include "MapMask.h"
+
+namespace
+{
+	/* 命令行参数 */
+	struct Options
+	{
+		std::string					config_file;
+		std::string					config_output;
+		std::string					input;
+		std::string					output;
+		std::string					pack_output;
+		std::vector<std::string>	pack_inputs;
+	};
+
+	std::string ReadFile(const std::string &filename)
+	{
+		std::ifstream stream(filename.c_str(), std::ios::binary);
+		if (!stream)
+		{
+			throw std::runtime_error("can't open file: " + filename);
+		}
+		return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	}
+
+	void WriteFile(const std::string &filename, const std::vector<uint8_t> &data)
+	{
+		FILE *file = fopen(filename.c_str(), "wb");
+		if (file == nullptr)
+		{
+			throw std::runtime_error("can't open file: " + filename);
+		}
+
+		const bool ok = data.empty() || fwrite(&data[0], 1, data.size(), file) == data.size();
+		fclose(file);
+		if (!ok)
+		{
+			throw std::runtime_error("can't write file: " + filename);
+		}
+	}
+
+	/* 读取 JSON 对象中的数值字段，配置文件只有一层，不需要完整的解析器 */
+	double ReadJsonNumber(const std::string &json, const char *key)
+	{
+		const std::string quoted = std::string("\"") + key + "\"";
+		size_t pos = json.find(quoted);
+		if (pos != std::string::npos)
+		{
+			pos = json.find_first_not_of(" \t\r\n", pos + quoted.size());
+		}
+		if (pos == std::string::npos || json[pos] != ':')
+		{
+			throw std::runtime_error(std::string("missing config field: ") + key);
+		}
+
+		const char *begin = json.c_str() + pos + 1;
+		char *end = nullptr;
+		const double value = strtod(begin, &end);
+		if (end == begin)
+		{
+			throw std::runtime_error(std::string("invalid config field: ") + key);
+		}
+		return value;
+	}
+
+	GameConfigRecord ReadGameConfig(const std::string &filename)
+	{
+		const std::string json = ReadFile(filename);
+
+		GameConfigRecord record;
+		memset(&record, 0, sizeof(record));
+		record.element_width = static_cast<uint16_t>(ReadJsonNumber(json, "Width"));
+		record.element_height = static_cast<uint16_t>(ReadJsonNumber(json, "Height"));
+		record.type_quantity = static_cast<uint16_t>(ReadJsonNumber(json, "TypeQuantity"));
+		record.move_time = static_cast<float>(ReadJsonNumber(json, "MoveTime"));
+		record.fall_down_time = static_cast<float>(ReadJsonNumber(json, "FallDownTime"));
+		if (record.type_quantity == 0 || record.element_width == 0 || record.element_height == 0)
+		{
+			throw std::runtime_error("invalid config file: " + filename);
+		}
+		return record;
+	}
+
+	/* 获取标签的属性值，不存在时返回空串 */
+	std::string GetAttribute(const std::string &tag, const char *name)
+	{
+		const std::string pattern = std::string(" ") + name + "=\"";
+		const size_t pos = tag.find(pattern);
+		if (pos == std::string::npos)
+		{
+			return std::string();
+		}
+		const size_t begin = pos + pattern.size();
+		const size_t end = tag.find('"', begin);
+		return end == std::string::npos ? std::string() : tag.substr(begin, end - begin);
+	}
+
+	/* 获取从 pos 开始的第一个 name 标签，返回标签本身，pos 移动到标签之后 */
+	std::string FindTag(const std::string &xml, const char *name, size_t &pos)
+	{
+		const std::string pattern = std::string("<") + name;
+		for (;;)
+		{
+			const size_t begin = xml.find(pattern, pos);
+			if (begin == std::string::npos)
+			{
+				return std::string();
+			}
+
+			// 排除名称相同前缀的标签
+			const char next = begin + pattern.size() < xml.size() ? xml[begin + pattern.size()] : '\0';
+			const size_t end = xml.find('>', begin);
+			if (end == std::string::npos)
+			{
+				return std::string();
+			}
+			pos = end + 1;
+			if (next == ' ' || next == '>' || next == '/' || next == '\t' || next == '\r' || next == '\n')
+			{
+				return xml.substr(begin, end + 1 - begin);
+			}
+		}
+	}
+
+	std::vector<uint8_t> DecodeBase64(const std::string &text)
+	{
+		std::vector<uint8_t> out;
+		out.reserve(text.size() * 3 / 4);
+
+		uint32_t buffer = 0;
+		int bits = 0;
+		for (char c : text)
+		{
+			int value;
+			if (c >= 'A' && c <= 'Z') value = c - 'A';
+			else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+			else if (c >= '0' && c <= '9') value = c - '0' + 52;
+			else if (c == '+') value = 62;
+			else if (c == '/') value = 63;
+			else if (c == '=') break;
+			else continue;
+
+			buffer = buffer << 6 | value;
+			bits += 6;
+			if (bits >= 8)
+			{
+				bits -= 8;
+				out.push_back(static_cast<uint8_t>(buffer >> bits));
+			}
+		}
+		return out;
+	}
+
+	/* 解压 zlib 或 gzip 数据 */
+	std::vector<uint8_t> Inflate(const std::vector<uint8_t> &input, size_t expected)
+	{
+		std::vector<uint8_t> out(expected);
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, 15 + 32) != Z_OK)
+		{
+			throw std::runtime_error("inflateInit failed!");
+		}
+
+		stream.next_in = const_cast<Bytef *>(input.empty() ? nullptr : &input[0]);
+		stream.avail_in = static_cast<uInt>(input.size());
+		stream.next_out = out.empty() ? nullptr : &out[0];
+		stream.avail_out = static_cast<uInt>(out.size());
+		const int result = inflate(&stream, Z_FINISH);
+		const size_t size = stream.total_out;
+		inflateEnd(&stream);
+		if (result != Z_STREAM_END || size != expected)
+		{
+			throw std::runtime_error("corrupted layer data!");
+		}
+		return out;
+	}
+
+	/* 读取 Tiled 地图，类型数量为第一个图层的名称 */
+	MapConfig ReadTmx(const std::string &filename)
+	{
+		const std::string xml = ReadFile(filename);
+
+		size_t pos = 0;
+		const std::string layer = FindTag(xml, "layer", pos);
+		const std::string data = FindTag(xml, "data", pos);
+		if (layer.empty() || data.empty())
+		{
+			throw std::runtime_error("no tile layer in map: " + filename);
+		}
+
+		MapConfig config;
+		config.width = atoi(GetAttribute(layer, "width").c_str());
+		config.height = atoi(GetAttribute(layer, "height").c_str());
+		config.type_quantity = atoi(GetAttribute(layer, "name").c_str());
+		if (config.width <= 0 || config.height <= 0 || config.type_quantity <= 0)
+		{
+			throw std::runtime_error("invalid layer in map: " + filename);
+		}
+
+		const size_t cells = static_cast<size_t>(config.width) * config.height;
+		const std::string encoding = GetAttribute(data, "encoding");
+		const std::string compression = GetAttribute(data, "compression");
+		const size_t content_end = xml.find("</data>", pos);
+		const std::string content = content_end == std::string::npos ? std::string() : xml.substr(pos, content_end - pos);
+
+		std::vector<uint32_t> gids;
+		gids.reserve(cells);
+		if (encoding == "base64")
+		{
+			std::vector<uint8_t> bytes = DecodeBase64(content);
+			if (compression == "zlib" || compression == "gzip")
+			{
+				bytes = Inflate(bytes, cells * 4);
+			}
+			else if (!compression.empty())
+			{
+				throw std::runtime_error("unsupported compression: " + compression);
+			}
+
+			for (size_t i = 0; i + 4 <= bytes.size(); i += 4)
+			{
+				gids.push_back(bytes[i] | bytes[i + 1] << 8 | bytes[i + 2] << 16 | static_cast<uint32_t>(bytes[i + 3]) << 24);
+			}
+		}
+		else if (encoding == "csv")
+		{
+			std::istringstream stream(content);
+			std::string field;
+			while (std::getline(stream, field, ','))
+			{
+				gids.push_back(static_cast<uint32_t>(strtoul(field.c_str(), nullptr, 10)));
+			}
+		}
+		else if (encoding.empty())
+		{
+			size_t tile_pos = pos;
+			for (size_t i = 0; i < cells; ++i)
+			{
+				const std::string tile = FindTag(xml, "tile", tile_pos);
+				if (tile.empty() || tile_pos > content_end)
+				{
+					break;
+				}
+				gids.push_back(static_cast<uint32_t>(strtoul(GetAttribute(tile, "gid").c_str(), nullptr, 10)));
+			}
+		}
+		else
+		{
+			throw std::runtime_error("unsupported encoding: " + encoding);
+		}
+
+		if (gids.size() != cells)
+		{
+			throw std::runtime_error("tile count mismatch in map: " + filename);
+		}
+
+		config.data.reserve(cells);
+		for (uint32_t gid : gids)
+		{
+			config.data.push_back(gid != 0);
+		}
+		return config;
+	}
+
+	bool EndsWith(const std::string &text, const char *suffix)
+	{
+		const size_t length = strlen(suffix);
+		return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+	}
+
+	/* 读取地图并按游戏配置限制类型数量 */
+	MapConfig ReadMap(const std::string &filename, const GameConfigRecord &game_config)
+	{
+		MapConfig config = EndsWith(filename, ".tmx") ? ReadTmx(filename) : tools::LoadMask(filename);
+		if (game_config.type_quantity > 0 && config.type_quantity > game_config.type_quantity)
+		{
+			config.type_quantity = game_config.type_quantity;
+		}
+		return config;
+	}
+
+	void PrintUsage()
+	{
+		printf("usage: eliminate_levelconv [--config config.json] [--config-out file] [map level]\n"
+			"       eliminate_levelconv [--config config.json] --pack file map...\n");
+	}
+
+	bool ParseOptions(int argc, char *argv[], Options &options)
+	{
+		std::vector<std::string> positional;
+		for (int i = 1; i < argc; ++i)
+		{
+			const char *arg = argv[i];
+			const bool has_value = i + 1 < argc;
+			if (strcmp(arg, "--config") == 0 && has_value)
+			{
+				options.config_file = argv[++i];
+			}
+			else if (strcmp(arg, "--config-out") == 0 && has_value)
+			{
+				options.config_output = argv[++i];
+			}
+			else if (strcmp(arg, "--pack") == 0 && has_value)
+			{
+				options.pack_output = argv[++i];
+			}
+			else if (arg[0] == '-')
+			{
+				return false;
+			}
+			else
+			{
+				positional.push_back(arg);
+			}
+		}
+
+		if (!options.pack_output.empty())
+		{
+			options.pack_inputs = positional;
+			return !positional.empty();
+		}
+		else if (positional.size() == 2)
+		{
+			options.input = positional[0];
+			options.output = positional[1];
+		}
+		else if (!positional.empty())
+		{
+			return false;
+		}
+
+		if (!options.config_output.empty() && options.config_file.empty())
+		{
+			return false;
+		}
+		return !options.input.empty() || !options.config_output.empty();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	try
+	{
+		GameConfigRecord game_config;
+		memset(&game_config, 0, sizeof(game_config));
+		if (!options.config_file.empty())
+		{
+			game_config = ReadGameConfig(options.config_file);
+		}
+
+		if (!options.config_output.empty())
+		{
+			std::vector<uint8_t> data;
+			EncodeGameConfig(game_config, data);
+			WriteFile(options.config_output, data);
+			printf("%s: %u bytes\n", options.config_output.c_str(), static_cast<unsigned int>(data.size()));
+		}
+
+		if (!options.pack_inputs.empty())
+		{
+			std::vector<MapConfig> levels;
+			levels.reserve(options.pack_inputs.size());
+			for (auto &input : options.pack_inputs)
+			{
+				levels.push_back(ReadMap(input, game_config));
+			}
+
+			std::vector<uint8_t> data;
+			EncodeLevelPack(levels, data);
+			WriteFile(options.pack_output, data);
+			printf("%s: %u levels, %u bytes\n", options.pack_output.c_str(),
+				static_cast<unsigned int>(levels.size()), static_cast<unsigned int>(data.size()));
+		}
+
+		if (!options.input.empty())
+		{
+			const MapConfig config = ReadMap(options.input, game_config);
+
+			std::vector<uint8_t> data;
+			EncodeLevel(config, data);
+			WriteFile(options.output, data);
+			printf("%s: %dx%d, %d types, %u bytes\n", options.output.c_str(),
+				config.width, config.height, config.type_quantity, static_cast<unsigned int>(data.size()));
+		}
+	}
+	catch (const std::exception &e)
+	{
+		fprintf(stderr, "error: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+﻿/**
+ * 工具共用的文本地图掩码
+ * 首个有效行为类型数量，其余每行由 0/1 组成，'#' 开头的行为注释
+ * 也可以直接读取 eliminate_levelconv 生成的二进制关卡
+ */
+
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Types.h"
+#include "Level.h"
+
+namespace tools
+{
+	/* 内置地图，与 Resources/map/map.tmx 一致 */
+	static const char *kDefaultMap =
+		"2\n"
+		"11000011\n"
+		"11111111\n"
+		"01000010\n"
+		"01111110\n"
+		"01111110\n"
+		"11100111\n"
+		"11111111\n"
+		"00111100\n";
+
+	/**
+	 * 解析地图掩码
+	 */
+	inline MapConfig ParseMask(std::istream &stream)
+	{
+		MapConfig config;
+		config.width = 0;
+		config.height = 0;
+		config.type_quantity = 0;
+
+		std::string line;
+		while (std::getline(stream, line))
+		{
+			line.erase(std::remove_if(line.begin(), line.end(), [](char c)
+			{
+				return c == '\r' || c == ' ' || c == '\t';
+			}), line.end());
+
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+
+			if (config.type_quantity == 0)
+			{
+				config.type_quantity = atoi(line.c_str());
+				continue;
+			}
+
+			if (config.width == 0)
+			{
+				config.width = line.size();
+			}
+			else if (config.width != static_cast<int>(line.size()))
+			{
+				throw std::runtime_error("inconsistent map width!");
+			}
+
+			for (auto c : line)
+			{
+				config.data.push_back(c != '0');
+			}
+			++config.height;
+		}
+
+		if (config.type_quantity <= 0 || config.width == 0 || config.height == 0)
+		{
+			throw std::runtime_error("invalid map file!");
+		}
+		return config;
+	}
+
+	/**
+	 * 读取地图掩码或二进制关卡，文件名为空时使用内置地图
+	 */
+	inline MapConfig LoadMask(const std::string &filename)
+	{
+		if (filename.empty())
+		{
+			std::istringstream stream(kDefaultMap);
+			return ParseMask(stream);
+		}
+
+		std::ifstream stream(filename.c_str(), std::ios::binary);
+		if (!stream)
+		{
+			throw std::runtime_error("can't open map file: " + filename);
+		}
+
+		char magic[4] = { 0 };
+		stream.read(magic, sizeof(magic));
+		if (stream.gcount() == sizeof(magic) && IsLevelData(magic, sizeof(magic)))
+		{
+			return LoadLevel(filename);
+		}
+
+		stream.clear();
+		stream.seekg(0);
+		return ParseMask(stream);
+	}
+}
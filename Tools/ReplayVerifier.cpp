@@ -0,0 +1,127 @@
+﻿/**
+ * 回放校验
+ * 映射回放文件并通过 Backend::ResolveSwap 重放，检查结束时的棋盘与消除数量
+ *
+ * 用法: eliminate_replay [--map 文件] [--types 数量] [--repeat 次数] 回放文件...
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "Replay.h"
+#include "MapMask.h"
+#include "Misc/MappedFile.h"
+
+namespace
+{
+	/* 命令行参数 */
+	struct Options
+	{
+		std::string					map_file;
+		std::vector<std::string>	replay_files;
+		int							types;
+		int							repeat;			// 重复校验次数，用于测量吞吐量
+
+		Options() : types(0), repeat(1) {}
+	};
+
+	void PrintUsage()
+	{
+		printf("usage: eliminate_replay [--map file] [--types n] [--repeat n] replay...\n");
+	}
+
+	bool ParseOptions(int argc, char *argv[], Options &options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char *arg = argv[i];
+			const bool has_value = i + 1 < argc;
+			if (strcmp(arg, "--map") == 0 && has_value)
+			{
+				options.map_file = argv[++i];
+			}
+			else if (strcmp(arg, "--types") == 0 && has_value)
+			{
+				options.types = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--repeat") == 0 && has_value)
+			{
+				options.repeat = atoi(argv[++i]);
+			}
+			else if (arg[0] == '-')
+			{
+				return false;
+			}
+			else
+			{
+				options.replay_files.push_back(arg);
+			}
+		}
+		return !options.replay_files.empty() && options.repeat > 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	try
+	{
+		MapConfig config = tools::LoadMask(options.map_file);
+		if (options.types > 0)
+		{
+			config.type_quantity = options.types;
+		}
+
+		// 先映射全部文件，计时只包含校验
+		std::vector<MappedFile> files(options.replay_files.size());
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			files[i].Open(options.replay_files[i]);
+		}
+
+		ReplayVerifier verifier;
+		unsigned long long moves = 0;
+		unsigned int failed = 0;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (int round = 0; round < options.repeat; ++round)
+		{
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				const ReplayVerifier::Result result = verifier.Verify(config, files[i].GetData(), files[i].GetSize());
+				moves += verifier.GetVerifiedMoves();
+				if (result != ReplayVerifier::VERIFY_OK && round == 0)
+				{
+					++failed;
+					printf("%s: %s after %u moves\n", options.replay_files[i].c_str(),
+						ReplayVerifier::GetResultName(result), verifier.GetVerifiedMoves());
+				}
+			}
+		}
+		const auto finish = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration<double>(finish - start).count();
+
+		printf("replays:      %u\n", static_cast<unsigned int>(files.size()));
+		printf("failed:       %u\n", failed);
+		printf("moves:        %llu\n", moves);
+		printf("elapsed:      %.3f s\n", seconds);
+		printf("moves/s:      %.0f\n", seconds > 0.0 ? moves / seconds : 0.0);
+		return failed == 0 ? 0 : 2;
+	}
+	catch (const std::exception &e)
+	{
+		fprintf(stderr, "error: %s\n", e.what());
+		return 1;
+	}
+}
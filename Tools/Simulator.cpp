@@ -0,0 +1,309 @@
+﻿/**
+ * 无界面批量模拟
+ * 通过 Backend 的 SwapSprite / IsCanEliminate / DoEliminate / FalldownSprite 流程进行对局，统计每秒步数
+ *
+ * 用法: eliminate_sim [--map 文件] [--types 数量] [--games 局数] [--moves 步数] [--seed 种子] [--script 文件] [--resolver] [--record 文件]
+ * --record 将每局保存为回放文件，多局时文件名后追加 .局号
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "Backend.h"
+#include "Replay.h"
+#include "MapMask.h"
+
+namespace
+{
+	/* 命令行参数 */
+	struct Options
+	{
+		std::string		map_file;
+		std::string		script_file;
+		std::string		record_file;
+		int				types;
+		int				games;
+		int				moves;
+		unsigned int	seed;
+		bool			resolver;		// 使用 ResolveSwap 同步结算
+
+		Options() : types(0), games(100), moves(50), seed(5489u), resolver(false) {}
+	};
+
+	/* 统计数据 */
+	struct Statistics
+	{
+		unsigned long long	moves;			// 有效步数
+		unsigned long long	swaps;			// 尝试交换次数
+		unsigned long long	eliminated;		// 消除精灵数量
+		unsigned long long	cascades;		// 连锁消除次数
+		unsigned long long	dead_boards;	// 无步可走的局数
+
+		Statistics() : moves(0), swaps(0), eliminated(0), cascades(0), dead_boards(0) {}
+	};
+
+	/* 读取脚本，每行为一次交换: row col row col */
+	std::vector<std::pair<MapIndex, MapIndex>> LoadScript(const std::string &filename)
+	{
+		std::vector<std::pair<MapIndex, MapIndex>> script;
+		std::ifstream stream(filename.c_str());
+		if (!stream)
+		{
+			throw std::runtime_error("can't open script file: " + filename);
+		}
+
+		std::string line;
+		while (std::getline(stream, line))
+		{
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+			std::istringstream fields(line);
+			MapIndex a, b;
+			if (fields >> a.row >> a.col >> b.row >> b.col)
+			{
+				script.push_back(std::make_pair(a, b));
+			}
+		}
+		return script;
+	}
+
+	/* 执行落下与连锁消除，直到棋盘稳定，连锁层数上限与 Backend::ResolveSwap 相同 */
+	void Settle(Backend &backend, Statistics &stats)
+	{
+		CellSet eliminate_set;
+		FalldownResult falldown;
+		const int max_depth = backend.GetMaxCascadeDepth();
+		for (int depth = 0;; ++depth)
+		{
+			backend.FalldownAll(falldown);
+			if (!falldown.settled || depth >= max_depth)
+			{
+				throw std::runtime_error("board never settles!");
+			}
+			if (!backend.GetMovedSpriteAndCanEliminate(eliminate_set))
+			{
+				break;
+			}
+
+			++stats.cascades;
+			stats.eliminated += backend.DoEliminate(eliminate_set);
+		}
+	}
+
+	/* 是否使用同步结算 */
+	bool g_use_resolver = false;
+
+	/* 回放记录，未开启时为空 */
+	ReplayWriter *g_replay = nullptr;
+
+	/* 尝试交换，无法消除时交换回去 */
+	bool TryMove(Backend &backend, const MapIndex &a, const MapIndex &b, Statistics &stats)
+	{
+		if (!backend.IsValidSprite(a) || !backend.IsValidSprite(b) || !backend.IsAdjacent(a, b))
+		{
+			return false;
+		}
+
+		++stats.swaps;
+		if (g_use_resolver)
+		{
+			static CascadeLog log;
+			const Backend::ResolveResult result = backend.ResolveSwap(a, b, log);
+			if (result == Backend::RESOLVE_INVALID)
+			{
+				return false;
+			}
+			if (result == Backend::RESOLVE_UNSTABLE)
+			{
+				throw std::runtime_error("board never settles!");
+			}
+			if (g_replay) g_replay->AddMove(a, b);
+			++stats.moves;
+			stats.eliminated += log.GetEliminated();
+			stats.cascades += log.GetMaxDepth();
+			return true;
+		}
+
+		backend.SwapSprite(a, b);
+
+		CellSet eliminate_set;
+		if (!backend.IsCanEliminate(b, a, eliminate_set))
+		{
+			backend.SwapSprite(a, b);
+			return false;
+		}
+
+		if (g_replay) g_replay->AddMove(a, b);
+		++stats.moves;
+		stats.eliminated += backend.DoEliminate(eliminate_set);
+		Settle(backend, stats);
+		return true;
+	}
+
+	/* 随机选取一步可消除的交换 */
+	bool RandomMove(Backend &backend, std::mt19937 &generator, std::vector<SwapMove> &candidates, Statistics &stats)
+	{
+		if (backend.GenerateMoves(candidates) == 0)
+		{
+			return false;
+		}
+
+		std::uniform_int_distribution<size_t> dis(0, candidates.size() - 1);
+		const SwapMove &move = candidates[dis(generator)];
+		return TryMove(backend, move.from, move.to, stats);
+	}
+
+	void PrintUsage()
+	{
+		printf("usage: eliminate_sim [--map file] [--types n] [--games n] [--moves n] [--seed n] [--script file] [--resolver] [--record file]\n");
+	}
+
+	bool ParseOptions(int argc, char *argv[], Options &options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char *arg = argv[i];
+			const bool has_value = i + 1 < argc;
+			if (strcmp(arg, "--map") == 0 && has_value)
+			{
+				options.map_file = argv[++i];
+			}
+			else if (strcmp(arg, "--script") == 0 && has_value)
+			{
+				options.script_file = argv[++i];
+			}
+			else if (strcmp(arg, "--record") == 0 && has_value)
+			{
+				options.record_file = argv[++i];
+			}
+			else if (strcmp(arg, "--types") == 0 && has_value)
+			{
+				options.types = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--games") == 0 && has_value)
+			{
+				options.games = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--moves") == 0 && has_value)
+			{
+				options.moves = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--resolver") == 0)
+			{
+				options.resolver = true;
+			}
+			else if (strcmp(arg, "--seed") == 0 && has_value)
+			{
+				options.seed = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return options.games > 0 && options.moves > 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	try
+	{
+		MapConfig config = tools::LoadMask(options.map_file);
+		if (options.types > 0)
+		{
+			config.type_quantity = options.types;
+		}
+
+		std::vector<std::pair<MapIndex, MapIndex>> script;
+		if (!options.script_file.empty())
+		{
+			script = LoadScript(options.script_file);
+		}
+
+		g_use_resolver = options.resolver;
+
+		ReplayWriter replay;
+		if (!options.record_file.empty())
+		{
+			g_replay = &replay;
+		}
+
+		Statistics stats;
+		NullBackendDelegate delegate;
+		Backend backend(&delegate);
+		std::mt19937 generator(options.seed);
+		std::vector<SwapMove> candidates;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (int game = 0; game < options.games; ++game)
+		{
+			backend.SetSeed(options.seed, game);
+			backend.SetMap(config);
+			if (g_replay) replay.Begin(config, options.seed, game);
+			const unsigned long long eliminated = stats.eliminated;
+
+			if (!script.empty())
+			{
+				for (auto &swap : script)
+				{
+					TryMove(backend, swap.first, swap.second, stats);
+				}
+			}
+			else
+			{
+				for (int move = 0; move < options.moves; ++move)
+				{
+					if (!RandomMove(backend, generator, candidates, stats))
+					{
+						++stats.dead_boards;
+						break;
+					}
+				}
+			}
+
+			if (g_replay)
+			{
+				replay.Finish(backend.GetBoardHash(), static_cast<unsigned int>(stats.eliminated - eliminated));
+				replay.Save(options.games > 1 ? options.record_file + "." + std::to_string(game) : options.record_file);
+			}
+		}
+		const auto finish = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration<double>(finish - start).count();
+
+		printf("map:          %dx%d, %d types\n", config.width, config.height, config.type_quantity);
+		printf("games:        %d\n", options.games);
+		printf("moves:        %llu\n", stats.moves);
+		printf("swaps tried:  %llu\n", stats.swaps);
+		printf("eliminated:   %llu\n", stats.eliminated);
+		printf("cascades:     %llu\n", stats.cascades);
+		printf("dead boards:  %llu\n", stats.dead_boards);
+		printf("elapsed:      %.3f s\n", seconds);
+		printf("moves/s:      %.0f\n", seconds > 0.0 ? stats.moves / seconds : 0.0);
+		printf("swaps/s:      %.0f\n", seconds > 0.0 ? stats.swaps / seconds : 0.0);
+	}
+	catch (const std::exception &e)
+	{
+		fprintf(stderr, "error: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
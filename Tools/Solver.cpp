@@ -0,0 +1,492 @@
+﻿/**
+ * 自动求解
+ * 对交换进行束搜索，使用 Backend 的真实规则结算连锁，各线程分担第一步（根并行）
+ * 搜索节点只保存棋盘字节与 Philox 状态，存放在固定步长的连续内存中，复制一个节点只需一次 memcpy
+ *
+ * 用法: eliminate_solver [--map 文件] [--types 数量] [--games 局数] [--moves 步数] [--target 消除数]
+ *                       [--beam 宽度] [--depth 深度] [--threads 线程数] [--seed 种子] [--peek]
+ * --peek 搜索时使用真实的随机数状态，即预知补充的精灵，得到的是上限而不是玩家可达的结果
+ */
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "Backend.h"
+#include "MapMask.h"
+
+namespace
+{
+	/* 命令行参数 */
+	struct Options
+	{
+		std::string		map_file;
+		int				types;
+		int				games;
+		int				moves;			// 每局最大步数
+		int				target;			// 目标消除数
+		int				beam;			// 束宽
+		int				depth;			// 搜索深度，包含第一步
+		int				threads;
+		uint64_t		seed;
+		bool			peek;
+
+		Options()
+			: types(0)
+			, games(20)
+			, moves(50)
+			, target(1000000)
+			, beam(64)
+			, depth(3)
+			, threads(0)
+			, seed(5489u)
+			, peek(false)
+		{
+		}
+	};
+
+	/* 搜索节点头部，其后紧跟 宽 * 高 个字节的棋盘 */
+	struct NodeHeader
+	{
+		PhiloxState		random;			// 结算后的随机数状态
+		uint32_t		eliminated;		// 从根节点起累计的消除数量
+		uint32_t		root;			// 所属的第一步
+	};
+
+	/* 固定步长的节点数组 */
+	class NodeArena
+	{
+	public:
+		NodeArena() : stride_(0), size_(0) {}
+
+	public:
+		void Reset(size_t cells)
+		{
+			// 按缓存行对齐步长
+			stride_ = (sizeof(NodeHeader) + cells + 63) & ~size_t(63);
+			size_ = 0;
+		}
+
+		void Clear() { size_ = 0; }
+
+		size_t Size() const { return size_; }
+
+		NodeHeader* Push()
+		{
+			if ((size_ + 1) * stride_ > data_.size())
+			{
+				data_.resize(std::max(data_.size() * 2, stride_ * 64));
+			}
+			return Get(size_++);
+		}
+
+		NodeHeader* Get(size_t index)
+		{
+			return reinterpret_cast<NodeHeader *>(&data_[index * stride_]);
+		}
+
+		static uint8_t* GetCells(NodeHeader *node)
+		{
+			return reinterpret_cast<uint8_t *>(node + 1);
+		}
+
+		/* 复制节点到末尾 */
+		void Append(const NodeHeader *node)
+		{
+			memcpy(Push(), node, stride_);
+		}
+
+	private:
+		size_t					stride_;
+		size_t					size_;
+		std::vector<uint8_t>	data_;
+	};
+
+	/* 每个线程一个的搜索器 */
+	class Searcher
+	{
+	public:
+		Searcher()
+			: backend_(&delegate_)
+			, expanded_(0)
+		{
+			backend_.SetRandomEngine(&engine_);
+			candidates_.reserve(256);
+		}
+
+	public:
+		void SetMap(const MapConfig &config)
+		{
+			backend_.SetMap(config);
+			cells_ = config.width * config.height;
+			beam_.Reset(cells_);
+			children_.Reset(cells_);
+		}
+
+		/**
+		 * 对 first, first + step, ... 号第一步进行束搜索
+		 * @param root 根节点
+		 * @param root_moves 根节点的全部可行交换
+		 * @param best 输出每个第一步能达到的最大消除数量
+		 */
+		void Search(NodeHeader *root, const std::vector<SwapMove> &root_moves, size_t first, size_t step,
+			const Options &options, std::vector<uint32_t> &best)
+		{
+			beam_.Clear();
+			for (size_t i = first; i < root_moves.size(); i += step)
+			{
+				Expand(root, root_moves[i], static_cast<uint32_t>(i), beam_);
+			}
+			for (size_t i = 0; i < beam_.Size(); ++i)
+			{
+				Record(beam_.Get(i), best);
+			}
+
+			for (int level = 1; level < options.depth && beam_.Size() > 0; ++level)
+			{
+				children_.Clear();
+				for (size_t i = 0; i < beam_.Size(); ++i)
+				{
+					NodeHeader *node = beam_.Get(i);
+					Load(node);
+					backend_.GenerateMoves(candidates_);
+					for (size_t m = 0; m < candidates_.size(); ++m)
+					{
+						if (m > 0)
+						{
+							Load(node);
+						}
+						Expand(nullptr, candidates_[m], node->root, children_, node);
+					}
+				}
+
+				// 保留消除数量最多的节点
+				order_.resize(children_.Size());
+				for (size_t i = 0; i < order_.size(); ++i)
+				{
+					order_[i] = static_cast<uint32_t>(i);
+					Record(children_.Get(i), best);
+				}
+				const size_t keep = std::min(order_.size(), static_cast<size_t>(options.beam));
+				std::partial_sort(order_.begin(), order_.begin() + keep, order_.end(), [this](uint32_t a, uint32_t b)
+				{
+					return children_.Get(a)->eliminated > children_.Get(b)->eliminated;
+				});
+
+				beam_.Clear();
+				for (size_t i = 0; i < keep; ++i)
+				{
+					beam_.Append(children_.Get(order_[i]));
+				}
+			}
+		}
+
+		unsigned long long GetExpanded() const { return expanded_; }
+
+	private:
+		void Load(NodeHeader *node)
+		{
+			backend_.LoadSprites(NodeArena::GetCells(node));
+			engine_.SetState(node->random);
+		}
+
+		/* 在当前状态上执行交换，结果写入 arena */
+		void Expand(NodeHeader *root, const SwapMove &move, uint32_t root_index, NodeArena &arena, NodeHeader *parent = nullptr)
+		{
+			if (root)
+			{
+				Load(root);
+			}
+			const Backend::ResolveResult result = backend_.ResolveSwap(move.from, move.to, log_);
+			if (result == Backend::RESOLVE_INVALID)
+			{
+				throw std::runtime_error("generated move can't eliminate!");
+			}
+			if (result == Backend::RESOLVE_UNSTABLE)
+			{
+				throw std::runtime_error("board never settles!");
+			}
+			++expanded_;
+
+			NodeHeader *child = arena.Push();
+			child->random = engine_.GetState();
+			child->eliminated = (parent ? parent->eliminated : 0) + log_.GetEliminated();
+			child->root = root_index;
+			backend_.StoreSprites(NodeArena::GetCells(child));
+		}
+
+		static void Record(const NodeHeader *node, std::vector<uint32_t> &best)
+		{
+			if (node->eliminated > best[node->root])
+			{
+				best[node->root] = node->eliminated;
+			}
+		}
+
+	private:
+		NullBackendDelegate		delegate_;
+		Backend					backend_;
+		PhiloxEngine			engine_;
+		CascadeLog				log_;
+		size_t					cells_;
+		NodeArena				beam_;
+		NodeArena				children_;
+		std::vector<SwapMove>	candidates_;
+		std::vector<uint32_t>	order_;
+		unsigned long long		expanded_;
+	};
+
+	/* 搜索线程的第一个异常 */
+	struct WorkerError
+	{
+		std::mutex			mutex;
+		std::exception_ptr	error;
+
+		void Set(std::exception_ptr e)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+			{
+				error = e;
+			}
+		}
+	};
+
+	void PrintUsage()
+	{
+		printf("usage: eliminate_solver [--map file] [--types n] [--games n] [--moves n] [--target n]\n"
+			   "                        [--beam n] [--depth n] [--threads n] [--seed n] [--peek]\n");
+	}
+
+	bool ParseOptions(int argc, char *argv[], Options &options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char *arg = argv[i];
+			const bool has_value = i + 1 < argc;
+			if (strcmp(arg, "--map") == 0 && has_value)
+			{
+				options.map_file = argv[++i];
+			}
+			else if (strcmp(arg, "--types") == 0 && has_value)
+			{
+				options.types = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--games") == 0 && has_value)
+			{
+				options.games = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--moves") == 0 && has_value)
+			{
+				options.moves = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--target") == 0 && has_value)
+			{
+				options.target = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--beam") == 0 && has_value)
+			{
+				options.beam = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--depth") == 0 && has_value)
+			{
+				options.depth = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--threads") == 0 && has_value)
+			{
+				options.threads = atoi(argv[++i]);
+			}
+			else if (strcmp(arg, "--seed") == 0 && has_value)
+			{
+				options.seed = strtoull(argv[++i], nullptr, 10);
+			}
+			else if (strcmp(arg, "--peek") == 0)
+			{
+				options.peek = true;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return options.games > 0 && options.moves > 0 && options.target > 0 && options.beam > 0 && options.depth > 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	try
+	{
+		MapConfig config = tools::LoadMask(options.map_file);
+		if (options.types > 0)
+		{
+			config.type_quantity = options.types;
+		}
+
+		int threads = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+		if (threads <= 0)
+		{
+			threads = 1;
+		}
+
+		std::vector<Searcher> searchers(threads);
+		for (auto &searcher : searchers)
+		{
+			searcher.SetMap(config);
+		}
+
+		NullBackendDelegate delegate;
+		Backend backend(&delegate);
+		CascadeLog log;
+		std::vector<SwapMove> root_moves;
+		std::vector<uint32_t> best;
+		std::vector<std::thread> workers;
+
+		// 根节点
+		NodeArena root_arena;
+		root_arena.Reset(config.width * config.height);
+
+		unsigned long long total_moves = 0, total_eliminated = 0, reached = 0, dead = 0, moves_to_target = 0;
+		const auto start = std::chrono::steady_clock::now();
+
+		for (int game = 0; game < options.games; ++game)
+		{
+			PhiloxEngine engine(options.seed, game);
+			backend.SetRandomEngine(&engine);
+			backend.SetMap(config);
+
+			unsigned int eliminated = 0;
+			int move = 0;
+			for (; move < options.moves && eliminated < static_cast<unsigned int>(options.target); ++move)
+			{
+				if (backend.GenerateMoves(root_moves) == 0)
+				{
+					++dead;
+					break;
+				}
+
+				root_arena.Clear();
+				NodeHeader *root = root_arena.Push();
+				root->eliminated = 0;
+				root->root = 0;
+				backend.StoreSprites(NodeArena::GetCells(root));
+				if (options.peek)
+				{
+					root->random = engine.GetState();
+				}
+				else
+				{
+					// 不预知补充的精灵: 搜索使用独立的随机序列
+					PhiloxEngine guess(~options.seed, (uint64_t(game) << 32) | uint32_t(move));
+					root->random = guess.GetState();
+				}
+
+				best.assign(root_moves.size(), 0);
+				std::vector<std::vector<uint32_t>> partial(threads, best);
+				WorkerError error;
+				auto search = [&](int t)
+				{
+					// 异常离开线程函数会调用 std::terminate，记录后等所有线程结束再由主线程抛出
+					try
+					{
+						searchers[t].Search(root, root_moves, t, threads, options, partial[t]);
+					}
+					catch (...)
+					{
+						error.Set(std::current_exception());
+					}
+				};
+				for (int t = 1; t < threads; ++t)
+				{
+					workers.push_back(std::thread(search, t));
+				}
+				search(0);
+				for (auto &worker : workers)
+				{
+					worker.join();
+				}
+				workers.clear();
+				if (error.error)
+				{
+					std::rethrow_exception(error.error);
+				}
+
+				// 合并各线程的结果，相同时选择序号较小的交换
+				size_t choice = 0;
+				for (size_t i = 0; i < root_moves.size(); ++i)
+				{
+					for (int t = 0; t < threads; ++t)
+					{
+						best[i] = std::max(best[i], partial[t][i]);
+					}
+					if (best[i] > best[choice])
+					{
+						choice = i;
+					}
+				}
+
+				if (backend.ResolveSwap(root_moves[choice].from, root_moves[choice].to, log) != Backend::RESOLVE_OK)
+				{
+					throw std::runtime_error("board never settles!");
+				}
+				eliminated += log.GetEliminated();
+			}
+
+			total_moves += move;
+			total_eliminated += eliminated;
+			if (eliminated >= static_cast<unsigned int>(options.target))
+			{
+				++reached;
+				moves_to_target += move;
+			}
+		}
+
+		const auto finish = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration<double>(finish - start).count();
+
+		unsigned long long expanded = 0;
+		for (auto &searcher : searchers)
+		{
+			expanded += searcher.GetExpanded();
+		}
+
+		printf("map:            %dx%d, %d types\n", config.width, config.height, config.type_quantity);
+		printf("search:         beam %d, depth %d, %d threads%s\n", options.beam, options.depth, threads, options.peek ? ", peek" : "");
+		printf("games:          %d\n", options.games);
+		printf("moves:          %llu\n", total_moves);
+		printf("eliminated:     %llu (%.2f per move)\n", total_eliminated, total_moves ? double(total_eliminated) / total_moves : 0.0);
+		printf("reached target: %llu", reached);
+		if (reached)
+		{
+			printf(" (%.2f moves)", double(moves_to_target) / reached);
+		}
+		printf("\n");
+		printf("dead boards:    %llu\n", dead);
+		printf("expanded:       %llu nodes\n", expanded);
+		printf("elapsed:        %.3f s\n", seconds);
+		printf("nodes/s:        %.0f (%.0f per thread)\n", seconds > 0.0 ? expanded / seconds : 0.0,
+			seconds > 0.0 ? expanded / seconds / threads : 0.0);
+	}
+	catch (const std::exception &e)
+	{
+		fprintf(stderr, "error: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}